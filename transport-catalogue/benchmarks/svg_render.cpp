@@ -0,0 +1,136 @@
+// Compares rendering of a large synthetic map by svg::Document, which prints
+// every number through std::ostream, and by svg::CompactDocument, which
+// formats into one svg::OutputBuffer and flushes it once.
+//
+// Build from this directory:
+//     g++ -std=c++20 -O2 -I.. svg_render.cpp ../svg.cpp -o svg_render
+// Usage: svg_render [buses] [stops] [repeats]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "svg.h"
+
+using namespace std::literals;
+
+namespace {
+
+struct Shapes {
+    std::vector<svg::Polyline> lines;
+    std::vector<svg::Text> texts;
+    std::vector<svg::Circle> circles;
+};
+
+// Shapes like the ones MapRenderer draws, with random coordinates
+Shapes MakeShapes(int buses, int stops) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> coordinate(0.0, 1200.0);
+    std::uniform_int_distribution<int> route_size(5, 40);
+    const std::vector<svg::Color> palette{"green"s, svg::Rgb(255, 160, 0), "red"s, svg::Rgba(10, 20, 30, 0.85)};
+
+    Shapes shapes;
+    for (int bus = 0; bus < buses; ++bus) {
+        auto line = svg::Polyline()
+            .SetFillColor("none"s)
+            .SetStrokeColor(palette[bus % palette.size()])
+            .SetStrokeWidth(14)
+            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        for (int i = route_size(generator); i > 0; --i) {
+            line.AddPoint({coordinate(generator), coordinate(generator)});
+        }
+        shapes.lines.push_back(std::move(line));
+
+        shapes.texts.push_back(svg::Text()
+            .SetFillColor(palette[bus % palette.size()])
+            .SetPosition({coordinate(generator), coordinate(generator)})
+            .SetOffset({7, 15})
+            .SetFontSize(20)
+            .SetFontFamily("Verdana")
+            .SetFontWeight("bold")
+            .SetData("Bus "s + std::to_string(bus)));
+    }
+    for (int stop = 0; stop < stops; ++stop) {
+        const svg::Point center{coordinate(generator), coordinate(generator)};
+        shapes.circles.push_back(svg::Circle().SetCenter(center).SetRadius(5).SetFillColor("white"s));
+        shapes.texts.push_back(svg::Text()
+            .SetFillColor(svg::Rgba(255, 255, 255, 0.85))
+            .SetStrokeColor(svg::Rgba(255, 255, 255, 0.85))
+            .SetStrokeWidth(3)
+            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
+            .SetPosition(center)
+            .SetOffset({7, -3})
+            .SetFontSize(18)
+            .SetFontFamily("Verdana")
+            .SetData("Stop \"<"s + std::to_string(stop) + ">\" & Co"s));
+    }
+    return shapes;
+}
+
+template <typename Document>
+void Fill(Document& document, const Shapes& shapes) {
+    for (const auto& line : shapes.lines) {
+        document.Add(line);
+    }
+    for (const auto& circle : shapes.circles) {
+        document.Add(circle);
+    }
+    for (const auto& text : shapes.texts) {
+        document.Add(text);
+    }
+}
+
+template <typename Function>
+double MeasureMilliseconds(int repeats, Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        function();
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const int buses = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int stops = argc > 2 ? std::atoi(argv[2]) : 20000;
+    const int repeats = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    const Shapes shapes = MakeShapes(buses, stops);
+    svg::Document document;
+    Fill(document, shapes);
+    svg::CompactDocument compact_document;
+    Fill(compact_document, shapes);
+
+    std::string document_text;
+    const double document_time = MeasureMilliseconds(repeats, [&] {
+        std::ostringstream out;
+        document.Render(out);
+        document_text = std::move(out).str();
+    });
+
+    std::string compact_text;
+    const double compact_time = MeasureMilliseconds(repeats, [&] {
+        svg::OutputBuffer out;
+        compact_document.Render(out);
+        compact_text = out.Extract();
+    });
+
+    std::cout << "svg size: "sv << document_text.size() << " bytes\n"sv
+              << "svg::Document::Render:        "sv << document_time << " ms\n"sv
+              << "svg::CompactDocument::Render: "sv << compact_time << " ms\n"sv;
+
+    if (document_text != compact_text) {
+        std::cout << "texts differ\n"sv;
+        return 1;
+    }
+    std::cout << "texts are the same\n"sv;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <barrier>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// All-pairs router with the same answers as Router, stored as two flat V x V
+// matrices (weights and last edges) instead of nested optionals. The relaxation
+// keeps Router's k-major order, so every cell sees the same sequence of updates:
+// within one k step the rows are independent and split between worker threads,
+// and each row is processed in column tiles that keep row k hot in cache.
+template <typename Weight>
+class BlockedRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using Traits = WeightTraits<Weight>;
+    using Value = typename Traits::Value;
+
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+    explicit BlockedRouter(const Graph& graph,
+                           size_t thread_count = std::thread::hardware_concurrency());
+    // Restores a router from matrices previously taken from GetWeights and GetPrevEdges
+    BlockedRouter(const Graph& graph, std::vector<Value> weights, std::vector<EdgeId> prev_edges);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // Row-major V x V matrices, infinity and NO_EDGE mark missing routes
+    const std::vector<Value>& GetWeights() const;
+    const std::vector<EdgeId>& GetPrevEdges() const;
+
+private:
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr Value INFINITE_VALUE = Traits::Infinity();
+    static constexpr size_t TILE_SIZE = 1024;
+
+    void InitializeRoutesInternalData();
+    void RelaxRowsThroughVertex(VertexId vertex_through, size_t first_row, size_t row_step);
+
+    Value* WeightsRow(VertexId vertex) {
+        return weights_.data() + vertex * vertex_count_;
+    }
+    EdgeId* PrevEdgesRow(VertexId vertex) {
+        return prev_edges_.data() + vertex * vertex_count_;
+    }
+
+    const Graph& graph_;
+    size_t vertex_count_;
+    std::vector<Value> weights_;
+    std::vector<EdgeId> prev_edges_;
+};
+
+template <typename Weight>
+BlockedRouter<Weight>::BlockedRouter(const Graph& graph, size_t thread_count)
+    : graph_(graph)
+    , vertex_count_(graph.GetVertexCount())
+    , weights_(vertex_count_ * vertex_count_, INFINITE_VALUE)
+    , prev_edges_(vertex_count_ * vertex_count_, NO_EDGE)
+{
+    InitializeRoutesInternalData();
+
+    thread_count = std::clamp<size_t>(thread_count, 1, std::max<size_t>(vertex_count_, 1));
+    if (thread_count == 1) {
+        for (VertexId vertex_through = 0; vertex_through < vertex_count_; ++vertex_through) {
+            RelaxRowsThroughVertex(vertex_through, 0, 1);
+        }
+        return;
+    }
+
+    // Rows are dealt round-robin so that unreachable (skipped) rows spread evenly,
+    // the barrier publishes row k of the next step to every worker
+    std::barrier sync_point(static_cast<std::ptrdiff_t>(thread_count));
+    auto worker = [this, thread_count, &sync_point](size_t first_row) {
+        for (VertexId vertex_through = 0; vertex_through < vertex_count_; ++vertex_through) {
+            RelaxRowsThroughVertex(vertex_through, first_row, thread_count);
+            sync_point.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t first_row = 1; first_row < thread_count; ++first_row) {
+        threads.emplace_back(worker, first_row);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+template <typename Weight>
+BlockedRouter<Weight>::BlockedRouter(const Graph& graph, std::vector<Value> weights,
+                                     std::vector<EdgeId> prev_edges)
+    : graph_(graph)
+    , vertex_count_(graph.GetVertexCount())
+    , weights_(std::move(weights))
+    , prev_edges_(std::move(prev_edges))
+{
+    if (weights_.size() != vertex_count_ * vertex_count_
+        || prev_edges_.size() != vertex_count_ * vertex_count_) {
+        throw std::invalid_argument("Routes data doesn't match the graph");
+    }
+}
+
+template <typename Weight>
+const std::vector<typename BlockedRouter<Weight>::Value>& BlockedRouter<Weight>::GetWeights() const {
+    return weights_;
+}
+
+template <typename Weight>
+const std::vector<EdgeId>& BlockedRouter<Weight>::GetPrevEdges() const {
+    return prev_edges_;
+}
+
+template <typename Weight>
+void BlockedRouter<Weight>::InitializeRoutesInternalData() {
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        Value* weights = WeightsRow(vertex);
+        EdgeId* prev_edges = PrevEdgesRow(vertex);
+        weights[vertex] = Traits::ToValue(ZERO_WEIGHT);
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (edge.weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            if (weights[edge.to] > Traits::ToValue(edge.weight)) {
+                weights[edge.to] = Traits::ToValue(edge.weight);
+                prev_edges[edge.to] = edge_id;
+            }
+        }
+    }
+}
+
+template <typename Weight>
+void BlockedRouter<Weight>::RelaxRowsThroughVertex(VertexId vertex_through,
+                                                   size_t first_row, size_t row_step) {
+    // Row k never changes while relaxing through k: d[k][k] is zero and
+    // weights are non-negative, so it can be read without synchronisation
+    const Value* through_weights = WeightsRow(vertex_through);
+    const EdgeId* through_prev_edges = PrevEdgesRow(vertex_through);
+
+    for (size_t tile_begin = 0; tile_begin < vertex_count_; tile_begin += TILE_SIZE) {
+        const size_t tile_end = std::min(tile_begin + TILE_SIZE, vertex_count_);
+        for (VertexId vertex_from = first_row; vertex_from < vertex_count_; vertex_from += row_step) {
+            Value* weights = WeightsRow(vertex_from);
+            const Value weight_from = weights[vertex_through];
+            if (!(weight_from < INFINITE_VALUE) || vertex_from == vertex_through) {
+                continue;
+            }
+            EdgeId* prev_edges = PrevEdgesRow(vertex_from);
+
+            // Branch-free min-plus update so the compiler can vectorise it.
+            // The last edge of a path through k is the last edge of k -> to,
+            // which exists whenever the candidate is finite and to != k
+            for (VertexId vertex_to = tile_begin; vertex_to < tile_end; ++vertex_to) {
+                const Value current_weight = weights[vertex_to];
+                const EdgeId current_prev_edge = prev_edges[vertex_to];
+                const Value candidate_weight = weight_from + through_weights[vertex_to];
+                const EdgeId candidate_prev_edge = through_prev_edges[vertex_to];
+                const bool is_better = candidate_weight < current_weight;
+                weights[vertex_to] = is_better ? candidate_weight : current_weight;
+                prev_edges[vertex_to] = is_better ? candidate_prev_edge : current_prev_edge;
+            }
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename BlockedRouter<Weight>::RouteInfo> BlockedRouter<Weight>::BuildRoute(
+    VertexId from, VertexId to) const {
+    if (from >= vertex_count_ || to >= vertex_count_) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    const Value* weights = weights_.data() + from * vertex_count_;
+    const EdgeId* prev_edges = prev_edges_.data() + from * vertex_count_;
+    if (!(weights[to] < INFINITE_VALUE)) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = prev_edges[to];
+         edge_id != NO_EDGE;
+         edge_id = prev_edges[graph_.GetEdge(edge_id).from])
+    {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{Traits::FromValue(weights[to]), std::move(edges)};
+}
+
+}  // namespace graph
@@ -0,0 +1,129 @@
+#include "catalogue_queries.h"
+
+#include <algorithm>
+
+std::vector<std::optional<RouteInfo>> CatalogueQueries::BuildRoutes(
+    std::string_view stop_from,
+    std::span<const std::string_view> stops_to
+) const {
+    std::vector<std::optional<RouteInfo>> routes;
+    routes.reserve(stops_to.size());
+    for (const auto stop_to : stops_to) {
+        routes.push_back(BuildRoute(stop_from, stop_to));
+    }
+    return routes;
+}
+
+BuiltCatalogueQueries::BuiltCatalogueQueries(
+    const TransportCatalogue& catalogue,
+    MapRenderer& renderer,
+    const TransportRouter& router
+)
+    : catalogue_(catalogue)
+    , renderer_(renderer)
+    , router_(router) {
+}
+
+// The all-pairs modes answer every route from their tables, so only
+// ON_DEMAND gains from batches
+CatalogueQueries::Features BuiltCatalogueQueries::GetFeatures() const {
+    return Features{
+        .places = true,
+        .tiles = true,
+        .batched_routes = router_.GetRouterMode() == RouterMode::ON_DEMAND
+    };
+}
+
+std::optional<BusStat> BuiltCatalogueQueries::GetBusStat(std::string_view bus_name) const {
+    return catalogue_.GetBusStat(bus_name);
+}
+
+std::optional<std::vector<std::string_view>> BuiltCatalogueQueries::FindStopBuses(std::string_view stop_name) const {
+    auto stop = catalogue_.GetStop(stop_name);
+    if (stop == nullptr) {
+        return std::nullopt;
+    }
+
+    std::vector<std::string_view> buses_names;
+    for (auto& bus : catalogue_.GetBusesByStop(stop)) {
+        buses_names.emplace_back(bus->name);
+    }
+    std::sort(buses_names.begin(), buses_names.end());
+    return buses_names;
+}
+
+std::optional<RouteInfo> BuiltCatalogueQueries::BuildRoute(const RoutePoint& from, const RoutePoint& to) const {
+    return router_.BuildWalkingRoute(from, to);
+}
+
+// Unknown stops get no route and are left out of the search
+std::vector<std::optional<RouteInfo>> BuiltCatalogueQueries::BuildRoutes(
+    std::string_view stop_from,
+    std::span<const std::string_view> stops_to
+) const {
+    std::vector<std::optional<RouteInfo>> routes(stops_to.size());
+    const Stop* from = catalogue_.GetStop(stop_from);
+    if (from == nullptr) {
+        return routes;
+    }
+
+    std::vector<size_t> found;
+    std::vector<StopId> targets;
+    for (size_t index = 0; index < stops_to.size(); ++index) {
+        if (const Stop* to = catalogue_.GetStop(stops_to[index])) {
+            found.push_back(index);
+            targets.push_back(to->id);
+        }
+    }
+
+    auto built_routes = router_.BuildRoutes(from->id, targets);
+    for (size_t index = 0; index < found.size(); ++index) {
+        routes[found[index]] = std::move(built_routes[index]);
+    }
+    return routes;
+}
+
+std::string_view BuiltCatalogueQueries::GetMap() const {
+    return renderer_.GetMap(catalogue_);
+}
+
+std::optional<std::string> BuiltCatalogueQueries::RenderTile(int z, int x, int y) const {
+    if (!MapRenderer::HasTile(z, x, y)) {
+        return std::nullopt;
+    }
+    return renderer_.RenderTile(catalogue_, z, x, y);
+}
+
+MappedCatalogueQueries::MappedCatalogueQueries(const CatalogueView& view)
+    : view_(view) {
+}
+
+CatalogueQueries::Features MappedCatalogueQueries::GetFeatures() const {
+    return Features{};
+}
+
+std::optional<BusStat> MappedCatalogueQueries::GetBusStat(std::string_view bus_name) const {
+    return view_.GetBusStat(bus_name);
+}
+
+std::optional<std::vector<std::string_view>> MappedCatalogueQueries::FindStopBuses(std::string_view stop_name) const {
+    if (auto stop = view_.GetStop(stop_name)) {
+        return view_.GetBusesByStop(*stop);
+    }
+    return std::nullopt;
+}
+
+std::optional<RouteInfo> MappedCatalogueQueries::BuildRoute(const RoutePoint& from, const RoutePoint& to) const {
+    if (!std::holds_alternative<std::string_view>(from) || !std::holds_alternative<std::string_view>(to)) {
+        return std::nullopt;
+    }
+    return view_.BuildRoute(std::get<std::string_view>(from), std::get<std::string_view>(to));
+}
+
+std::string_view MappedCatalogueQueries::GetMap() const {
+    return view_.GetMap();
+}
+
+std::optional<std::string> MappedCatalogueQueries::RenderTile(int, int, int) const {
+    return std::nullopt;
+}
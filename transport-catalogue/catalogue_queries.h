@@ -0,0 +1,99 @@
+#pragma once
+
+#include "catalogue_view.h"
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What RequestHandler asks of a transport base. A base lists the optional
+// features it has, and requests for the others are answered with an error
+// before any query is made, so no query throws for a missing feature
+class CatalogueQueries {
+public:
+    struct Features {
+        // Routes with latitude/longitude ends
+        bool places = false;
+        // Map requests for one tile
+        bool tiles = false;
+        // Routes from one stop to several are cheaper built together by BuildRoutes
+        bool batched_routes = false;
+    };
+
+    virtual ~CatalogueQueries() = default;
+
+    virtual Features GetFeatures() const = 0;
+
+    virtual std::optional<BusStat> GetBusStat(std::string_view bus_name) const = 0;
+    // Sorted names of buses through the stop, empty for an unknown stop
+    virtual std::optional<std::vector<std::string_view>> FindStopBuses(std::string_view stop_name) const = 0;
+
+    // Empty for unknown stops, and for places without the places feature
+    virtual std::optional<RouteInfo> BuildRoute(const RoutePoint& from, const RoutePoint& to) const = 0;
+    // The same routes as BuildRoute from one stop to each of stops_to
+    virtual std::vector<std::optional<RouteInfo>> BuildRoutes(
+        std::string_view stop_from,
+        std::span<const std::string_view> stops_to
+    ) const;
+
+    // SVG document of the whole map
+    virtual std::string_view GetMap() const = 0;
+    // Empty for a tile outside the map, and without the tiles feature
+    virtual std::optional<std::string> RenderTile(int z, int x, int y) const = 0;
+};
+
+// Answers from a catalogue built from base_requests or loaded from a base.
+// Batches routes with the ON_DEMAND router only
+class BuiltCatalogueQueries final : public CatalogueQueries {
+public:
+    BuiltCatalogueQueries(
+        const TransportCatalogue& catalogue,
+        MapRenderer& renderer,
+        const TransportRouter& router
+    );
+
+    Features GetFeatures() const override;
+
+    std::optional<BusStat> GetBusStat(std::string_view bus_name) const override;
+    std::optional<std::vector<std::string_view>> FindStopBuses(std::string_view stop_name) const override;
+
+    std::optional<RouteInfo> BuildRoute(const RoutePoint& from, const RoutePoint& to) const override;
+    std::vector<std::optional<RouteInfo>> BuildRoutes(
+        std::string_view stop_from,
+        std::span<const std::string_view> stops_to
+    ) const override;
+
+    std::string_view GetMap() const override;
+    std::optional<std::string> RenderTile(int z, int x, int y) const override;
+
+private:
+    const TransportCatalogue& catalogue_;
+    MapRenderer& renderer_;
+    const TransportRouter& router_;
+};
+
+// Answers straight from a mapped snapshot. It keeps routes between stops and
+// the whole map only, with no walking settings or stop index, so it has none
+// of the features
+class MappedCatalogueQueries final : public CatalogueQueries {
+public:
+    explicit MappedCatalogueQueries(const CatalogueView& view);
+
+    Features GetFeatures() const override;
+
+    std::optional<BusStat> GetBusStat(std::string_view bus_name) const override;
+    std::optional<std::vector<std::string_view>> FindStopBuses(std::string_view stop_name) const override;
+
+    std::optional<RouteInfo> BuildRoute(const RoutePoint& from, const RoutePoint& to) const override;
+
+    std::string_view GetMap() const override;
+    std::optional<std::string> RenderTile(int z, int x, int y) const override;
+
+private:
+    const CatalogueView& view_;
+};
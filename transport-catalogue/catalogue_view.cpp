@@ -0,0 +1,483 @@
+#include "catalogue_view.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace std::literals;
+
+namespace {
+
+constexpr std::array<char, 8> MAGIC = {'T', 'C', 'V', 'I', 'E', 'W', '\0', '\0'};
+constexpr uint32_t VERSION = 1;
+
+// Every section starts at a multiple of this, enough for all record types
+constexpr size_t SECTION_ALIGNMENT = 8;
+
+enum Section : size_t {
+    STRINGS,
+    STOPS,
+    STOP_BUSES,
+    BUSES,
+    BUS_STOPS,
+    DISTANCES,
+    EDGES,
+    WEIGHTS,
+    PREV_EDGES,
+    MAP,
+    SECTION_COUNT,
+};
+
+using EdgeKind = TransportRouter::EdgeDescription::Kind;
+
+}  // namespace
+
+// The snapshot is a header followed by flat arrays of the records below,
+// in the host byte order. Stops and buses are sorted by name, so lookups are
+// binary searches and per-stop bus lists come out sorted by index.
+struct CatalogueView::Header {
+    struct SectionRef {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t vertex_count;
+    double wait_time;
+    std::array<SectionRef, SECTION_COUNT> sections;
+};
+
+struct CatalogueView::StopRecord {
+    uint64_t name_offset;
+    uint64_t name_size;
+    double lat;
+    double lng;
+    uint64_t buses_begin;
+    uint64_t buses_count;
+    uint64_t vertex;
+};
+
+struct CatalogueView::BusRecord {
+    uint64_t name_offset;
+    uint64_t name_size;
+    uint64_t stops_begin;
+    uint64_t stops_count;
+    BusStat stat;
+    uint8_t is_roundtrip;
+};
+
+// Sorted by (from, to)
+struct CatalogueView::DistanceRecord {
+    uint64_t from;
+    uint64_t to;
+    double distance;
+};
+
+// ref is the stop index of WAIT edges and the bus index of RIDE edges
+struct CatalogueView::EdgeRecord {
+    uint64_t from;
+    double weight;
+    uint64_t ref;
+    uint64_t span_count;
+    EdgeKind kind;
+};
+
+namespace {
+
+template <typename Record>
+bool NameLess(std::string_view strings, const Record& record, std::string_view name) {
+    return strings.substr(record.name_offset, record.name_size) < name;
+}
+
+}  // namespace
+
+CatalogueView::CatalogueView(const std::filesystem::path& file)
+    : file_(file)
+{
+    const std::string_view data = file_.GetData();
+    if (data.size() < sizeof(Header)) {
+        throw serialization::FormatError("Not a catalogue view snapshot"s);
+    }
+
+    header_ = reinterpret_cast<const Header*>(data.data());
+    if (header_->magic != MAGIC) {
+        throw serialization::FormatError("Not a catalogue view snapshot"s);
+    }
+    if (header_->version != VERSION) {
+        throw serialization::FormatError("Unsupported snapshot version "s + std::to_string(header_->version));
+    }
+
+    const std::array<size_t, SECTION_COUNT> item_sizes = {
+        sizeof(char), sizeof(StopRecord), sizeof(uint64_t), sizeof(BusRecord), sizeof(uint64_t),
+        sizeof(DistanceRecord), sizeof(EdgeRecord), sizeof(double), sizeof(graph::EdgeId), sizeof(char),
+    };
+    for (size_t section = 0; section < SECTION_COUNT; ++section) {
+        const auto [offset, count] = header_->sections[section];
+        if (offset % SECTION_ALIGNMENT != 0 || offset > data.size()
+            || count > (data.size() - offset) / item_sizes[section]) {
+            throw serialization::FormatError("Snapshot section is out of range"s);
+        }
+    }
+
+    const uint64_t vertex_count = header_->vertex_count;
+    if (header_->sections[WEIGHTS].count / std::max<uint64_t>(vertex_count, 1) != vertex_count
+        || header_->sections[PREV_EDGES].count != header_->sections[WEIGHTS].count) {
+        throw serialization::FormatError("Route tables don't match the graph"s);
+    }
+}
+
+template <typename T>
+std::span<const T> CatalogueView::GetSection(size_t section) const {
+    const auto [offset, count] = header_->sections[section];
+    return {reinterpret_cast<const T*>(file_.GetData().data() + offset), static_cast<size_t>(count)};
+}
+
+std::string_view CatalogueView::GetString(uint64_t offset, uint64_t size) const {
+    const auto strings = GetSection<char>(STRINGS);
+    if (offset > strings.size() || size > strings.size() - offset) {
+        throw serialization::FormatError("String is out of range"s);
+    }
+    return {strings.data() + offset, static_cast<size_t>(size)};
+}
+
+CatalogueView::StopView CatalogueView::MakeStopView(size_t index) const {
+    const auto& stop = GetSection<StopRecord>(STOPS)[index];
+    return {GetString(stop.name_offset, stop.name_size), geo::Coordinates{stop.lat, stop.lng}, index};
+}
+
+CatalogueView::BusView CatalogueView::MakeBusView(size_t index) const {
+    const auto& bus = GetSection<BusRecord>(BUSES)[index];
+    return {GetString(bus.name_offset, bus.name_size), bus.is_roundtrip != 0, index};
+}
+
+std::optional<CatalogueView::StopView> CatalogueView::GetStop(std::string_view name) const {
+    const auto stops = GetSection<StopRecord>(STOPS);
+    const auto strings_section = GetSection<char>(STRINGS);
+    const std::string_view strings(strings_section.data(), strings_section.size());
+
+    const auto it = std::lower_bound(stops.begin(), stops.end(), name,
+        [strings](const StopRecord& stop, std::string_view name) {
+            return NameLess(strings, stop, name);
+        });
+    if (it == stops.end() || GetString(it->name_offset, it->name_size) != name) {
+        return std::nullopt;
+    }
+    return MakeStopView(static_cast<size_t>(it - stops.begin()));
+}
+
+std::optional<CatalogueView::BusView> CatalogueView::GetBus(std::string_view name) const {
+    const auto buses = GetSection<BusRecord>(BUSES);
+    const auto strings_section = GetSection<char>(STRINGS);
+    const std::string_view strings(strings_section.data(), strings_section.size());
+
+    const auto it = std::lower_bound(buses.begin(), buses.end(), name,
+        [strings](const BusRecord& bus, std::string_view name) {
+            return NameLess(strings, bus, name);
+        });
+    if (it == buses.end() || GetString(it->name_offset, it->name_size) != name) {
+        return std::nullopt;
+    }
+    return MakeBusView(static_cast<size_t>(it - buses.begin()));
+}
+
+size_t CatalogueView::GetStopsCount() const {
+    return GetSection<StopRecord>(STOPS).size();
+}
+
+size_t CatalogueView::GetBusesCount() const {
+    return GetSection<BusRecord>(BUSES).size();
+}
+
+std::vector<std::string_view> CatalogueView::GetBusesByStop(const StopView& stop) const {
+    const auto& record = GetSection<StopRecord>(STOPS)[stop.index];
+    const auto bus_indices = GetSection<uint64_t>(STOP_BUSES);
+    if (record.buses_begin > bus_indices.size() || record.buses_count > bus_indices.size() - record.buses_begin) {
+        throw serialization::FormatError("Stop buses are out of range"s);
+    }
+
+    std::vector<std::string_view> buses;
+    buses.reserve(record.buses_count);
+    for (const auto bus_index : bus_indices.subspan(record.buses_begin, record.buses_count)) {
+        if (bus_index >= GetBusesCount()) {
+            throw serialization::FormatError("Bus index is out of range"s);
+        }
+        buses.push_back(MakeBusView(bus_index).name);
+    }
+    return buses;
+}
+
+std::vector<std::string_view> CatalogueView::GetStopsByBus(const BusView& bus) const {
+    const auto& record = GetSection<BusRecord>(BUSES)[bus.index];
+    const auto stop_indices = GetSection<uint64_t>(BUS_STOPS);
+    if (record.stops_begin > stop_indices.size() || record.stops_count > stop_indices.size() - record.stops_begin) {
+        throw serialization::FormatError("Bus stops are out of range"s);
+    }
+
+    std::vector<std::string_view> stops;
+    stops.reserve(record.stops_count);
+    for (const auto stop_index : stop_indices.subspan(record.stops_begin, record.stops_count)) {
+        if (stop_index >= GetStopsCount()) {
+            throw serialization::FormatError("Stop index is out of range"s);
+        }
+        stops.push_back(MakeStopView(stop_index).name);
+    }
+    return stops;
+}
+
+double CatalogueView::GetStopsDistance(const StopView& from, const StopView& to) const {
+    const auto distances = GetSection<DistanceRecord>(DISTANCES);
+    auto find = [distances](uint64_t from, uint64_t to) {
+        const auto it = std::lower_bound(distances.begin(), distances.end(), std::pair{from, to},
+            [](const DistanceRecord& record, std::pair<uint64_t, uint64_t> stops) {
+                return std::pair{record.from, record.to} < stops;
+            });
+        return it != distances.end() && it->from == from && it->to == to ? &*it : nullptr;
+    };
+
+    if (const auto* record = find(from.index, to.index)) {
+        return record->distance;
+    } else if (const auto* record = find(to.index, from.index)) {
+        return record->distance;
+    }
+    return geo::ComputeDistance(from.coordinates, to.coordinates);
+}
+
+std::optional<BusStat> CatalogueView::GetBusStat(std::string_view bus_name) const {
+    if (const auto bus = GetBus(bus_name)) {
+        return GetSection<BusRecord>(BUSES)[bus->index].stat;
+    }
+    return std::nullopt;
+}
+
+std::optional<RouteInfo> CatalogueView::BuildRoute(std::string_view stop_from, std::string_view stop_to) const {
+    if (stop_from == stop_to) {
+        return RouteInfo{};
+    }
+
+    const auto from = GetStop(stop_from);
+    const auto to = GetStop(stop_to);
+    if (!from || !to) {
+        return std::nullopt;
+    }
+
+    const auto stops = GetSection<StopRecord>(STOPS);
+    const auto edges = GetSection<EdgeRecord>(EDGES);
+    const uint64_t vertex_count = header_->vertex_count;
+    const uint64_t from_vertex = stops[from->index].vertex;
+    const uint64_t to_vertex = stops[to->index].vertex;
+    if (from_vertex >= vertex_count || to_vertex >= vertex_count) {
+        throw serialization::FormatError("Stop vertex is out of range"s);
+    }
+
+    const double* weights = GetSection<double>(WEIGHTS).data() + from_vertex * vertex_count;
+    const graph::EdgeId* prev_edges = GetSection<graph::EdgeId>(PREV_EDGES).data() + from_vertex * vertex_count;
+    if (!(weights[to_vertex] < std::numeric_limits<double>::infinity())) {
+        return std::nullopt;
+    }
+
+    std::vector<const EdgeRecord*> path;
+    for (graph::EdgeId edge_id = prev_edges[to_vertex];
+         edge_id != graph::BlockedRouter<Minutes>::NO_EDGE;
+         edge_id = prev_edges[path.back()->from])
+    {
+        if (edge_id >= edges.size() || path.size() == edges.size()) {
+            throw serialization::FormatError("Route tables are corrupted"s);
+        }
+        path.push_back(&edges[edge_id]);
+    }
+
+    // A wait item is emitted when a ride starts, so waiting at the last
+    // stop of a path is dropped and a path starting with a ride waits first
+    RouteInfo route;
+    route.total_time = Minutes{weights[to_vertex]};
+
+    const Minutes wait_time{header_->wait_time};
+    std::string_view wait_stop = from->name;
+    std::optional<RouteInfo::BusItem> ride;
+    auto finish_ride = [&route, &ride] {
+        if (ride) {
+            route.items.push_back(*ride);
+            ride.reset();
+        }
+    };
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        const EdgeRecord& edge = **it;
+        switch (edge.kind) {
+            case EdgeKind::WAIT:
+                if (edge.ref >= stops.size()) {
+                    throw serialization::FormatError("Stop index is out of range"s);
+                }
+                finish_ride();
+                wait_stop = MakeStopView(edge.ref).name;
+                break;
+            case EdgeKind::RIDE:
+                if (edge.ref >= GetBusesCount()) {
+                    throw serialization::FormatError("Bus index is out of range"s);
+                }
+                if (!ride) {
+                    route.items.push_back(RouteInfo::WaitItem{.stop = wait_stop, .time = wait_time});
+                    ride = RouteInfo::BusItem{.bus = MakeBusView(edge.ref).name, .span_count = 0, .time = Minutes{0}};
+                }
+                ride->span_count += edge.span_count;
+                ride->time += Minutes{edge.weight};
+                break;
+            case EdgeKind::ALIGHT:
+                finish_ride();
+                break;
+            default:
+                throw serialization::FormatError("Unknown edge kind"s);
+        }
+    }
+    finish_ride();
+
+    return route;
+}
+
+std::string_view CatalogueView::GetMap() const {
+    const auto map = GetSection<char>(MAP);
+    return {map.data(), map.size()};
+}
+
+void SaveCatalogueView(const std::filesystem::path& file,
+                       const TransportCatalogue& catalogue,
+                       const TransportRouter& router,
+                       std::string_view map) {
+    auto tables = router.GetRouteTables();
+    if (!tables) {
+        throw std::invalid_argument("Catalogue view needs an all-pairs router_mode"s);
+    }
+
+    auto stop_names = catalogue.GetStopsNames();
+    auto bus_names = catalogue.GetBusesNames();
+    std::sort(stop_names.begin(), stop_names.end());
+    std::sort(bus_names.begin(), bus_names.end());
+
+    std::unordered_map<std::string_view, uint64_t> stop_index_by_name;
+    for (size_t i = 0; i < stop_names.size(); ++i) {
+        stop_index_by_name[stop_names[i]] = i;
+    }
+    std::unordered_map<std::string_view, uint64_t> bus_index_by_name;
+    for (size_t i = 0; i < bus_names.size(); ++i) {
+        bus_index_by_name[bus_names[i]] = i;
+    }
+
+    std::vector<char> strings;
+    auto add_string = [&strings](std::string_view str) {
+        const uint64_t offset = strings.size();
+        strings.insert(strings.end(), str.begin(), str.end());
+        return offset;
+    };
+
+    std::vector<CatalogueView::StopRecord> stops;
+    std::vector<uint64_t> stop_buses;
+    for (const auto name : stop_names) {
+        const Stop* stop = catalogue.GetStop(name);
+
+        std::vector<uint64_t> buses;
+        for (const Bus* bus : catalogue.GetBusesByStop(stop)) {
+            buses.push_back(bus_index_by_name.at(bus->name));
+        }
+        std::sort(buses.begin(), buses.end());
+
+        CatalogueView::StopRecord record{};
+        record.name_offset = add_string(name);
+        record.name_size = name.size();
+        record.lat = stop->coordinates.lat;
+        record.lng = stop->coordinates.lng;
+        record.buses_begin = stop_buses.size();
+        record.buses_count = buses.size();
+        record.vertex = router.GetStopVertex(name);
+        stops.push_back(record);
+        stop_buses.insert(stop_buses.end(), buses.begin(), buses.end());
+    }
+
+    std::vector<CatalogueView::BusRecord> buses;
+    std::vector<uint64_t> bus_stops;
+    for (const auto name : bus_names) {
+        const Bus* bus = catalogue.GetBus(name);
+
+        CatalogueView::BusRecord record{};
+        record.name_offset = add_string(name);
+        record.name_size = name.size();
+        record.stops_begin = bus_stops.size();
+        record.stops_count = bus->stops.size();
+        record.stat = *catalogue.GetBusStat(name);
+        record.is_roundtrip = bus->is_roundtrip;
+        buses.push_back(record);
+        for (const StopId stop : bus->stops) {
+            bus_stops.push_back(stop_index_by_name.at(catalogue.GetStop(stop)->name));
+        }
+    }
+
+    std::vector<CatalogueView::DistanceRecord> distances;
+    for (const auto& [from, to, distance] : catalogue.GetStopsDistances()) {
+        distances.push_back({stop_index_by_name.at(from), stop_index_by_name.at(to), distance});
+    }
+    std::sort(distances.begin(), distances.end(), [](const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.from, lhs.to) < std::tie(rhs.from, rhs.to);
+    });
+
+    const auto& graph = router.GetGraph();
+    std::vector<CatalogueView::EdgeRecord> edges;
+    edges.reserve(graph.GetEdgeCount());
+    for (graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const auto description = router.DescribeEdge(edge_id);
+
+        CatalogueView::EdgeRecord record{};
+        record.from = graph.GetEdge(edge_id).from;
+        record.weight = graph.GetEdge(edge_id).weight.count();
+        record.kind = description.kind;
+        record.span_count = description.span_count;
+        if (description.kind == EdgeKind::WAIT) {
+            record.ref = stop_index_by_name.at(description.stop);
+        } else if (description.kind == EdgeKind::RIDE) {
+            record.ref = bus_index_by_name.at(description.bus);
+        }
+        edges.push_back(record);
+    }
+
+    CatalogueView::Header header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vertex_count = graph.GetVertexCount();
+    header.wait_time = router.GetBusWaitingTime().count();
+
+    std::string snapshot(sizeof(header), '\0');
+    auto add_section = [&snapshot, &header](Section section, const auto& items) {
+        using Item = typename std::decay_t<decltype(items)>::value_type;
+        static_assert(std::is_trivially_copyable_v<Item> && alignof(Item) <= SECTION_ALIGNMENT);
+        snapshot.resize((snapshot.size() + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT);
+        header.sections[section] = {snapshot.size(), items.size()};
+        snapshot.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(Item));
+    };
+
+    add_section(STRINGS, strings);
+    add_section(STOPS, stops);
+    add_section(STOP_BUSES, stop_buses);
+    add_section(BUSES, buses);
+    add_section(BUS_STOPS, bus_stops);
+    add_section(DISTANCES, distances);
+    add_section(EDGES, edges);
+    add_section(WEIGHTS, tables->weights);
+    add_section(PREV_EDGES, tables->prev_edges);
+    add_section(MAP, map);
+    std::copy_n(reinterpret_cast<const char*>(&header), sizeof(header), snapshot.data());
+
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Can't open "s + file.string() + " for writing"s);
+    }
+    out.write(snapshot.data(), static_cast<std::streamsize>(snapshot.size()));
+    if (!out) {
+        throw std::runtime_error("Failed to write "s + file.string());
+    }
+}
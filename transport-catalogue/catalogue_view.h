@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "domain.h"
+#include "geo.h"
+#include "mapped_file.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+// Read-only catalogue answering stat requests straight from a memory-mapped
+// snapshot written by SaveCatalogueView. Names, stop lists, bus stats, route
+// tables and the rendered map are read in place, so opening a base is one mmap
+// and pages are loaded only when a request touches them.
+class CatalogueView {
+public:
+    struct StopView {
+        std::string_view name;
+        geo::Coordinates coordinates;
+        size_t index;
+    };
+
+    struct BusView {
+        std::string_view name;
+        bool is_roundtrip;
+        size_t index;
+    };
+
+    explicit CatalogueView(const std::filesystem::path& file);
+
+    std::optional<StopView> GetStop(std::string_view name) const;
+    std::optional<BusView> GetBus(std::string_view name) const;
+
+    size_t GetStopsCount() const;
+    size_t GetBusesCount() const;
+
+    // Sorted by name
+    std::vector<std::string_view> GetBusesByStop(const StopView& stop) const;
+    std::vector<std::string_view> GetStopsByBus(const BusView& bus) const;
+
+    double GetStopsDistance(const StopView& from, const StopView& to) const;
+    std::optional<BusStat> GetBusStat(std::string_view bus_name) const;
+
+    // Same answers as TransportRouter::BuildRoute, empty for unknown stops
+    std::optional<RouteInfo> BuildRoute(std::string_view stop_from, std::string_view stop_to) const;
+
+    // SVG document of the whole map
+    std::string_view GetMap() const;
+
+private:
+    friend void SaveCatalogueView(const std::filesystem::path& file,
+                                  const TransportCatalogue& catalogue,
+                                  const TransportRouter& router,
+                                  std::string_view map);
+
+    struct Header;
+    struct StopRecord;
+    struct BusRecord;
+    struct DistanceRecord;
+    struct EdgeRecord;
+
+    template <typename T>
+    std::span<const T> GetSection(size_t section) const;
+
+    std::string_view GetString(uint64_t offset, uint64_t size) const;
+    StopView MakeStopView(size_t index) const;
+    BusView MakeBusView(size_t index) const;
+
+    MappedFile file_;
+    const Header* header_ = nullptr;
+};
+
+// Writes the snapshot CatalogueView maps. The router must keep route tables,
+// so the ON_DEMAND mode is rejected
+void SaveCatalogueView(const std::filesystem::path& file,
+                       const TransportCatalogue& catalogue,
+                       const TransportRouter& router,
+                       std::string_view map);
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Answers every BuildRoute with a separate Dijkstra search over the graph.
+// Construction only validates weights, so startup and memory stay linear in
+// graph size, unlike Router which precomputes all pairs.
+template <typename Weight>
+class DijkstraRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    explicit DijkstraRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // Routes from one vertex to each of targets, the same as BuildRoute
+    // gives, from one search that stops once every target is settled
+    std::vector<std::optional<RouteInfo>> BuildRoutes(VertexId from, std::span<const VertexId> targets) const;
+
+    // Weight of the lightest route from one vertex to each vertex and the
+    // last edge of it, empty for unreachable vertices. Like a row of the
+    // Router tables, the last edges lead back to the start
+    struct TreeItem {
+        Weight weight;
+        std::optional<EdgeId> prev_edge;
+    };
+    std::vector<std::optional<TreeItem>> BuildTree(VertexId from) const;
+
+    // Vertex where a route may start or end, with the weight of getting
+    // to it from the real start or from it to the real end
+    struct Terminal {
+        VertexId vertex;
+        Weight weight;
+    };
+
+    // Route from sources[source] to targets[target]. Its weight is the
+    // weight of the edges, without the weights of the terminals
+    struct TerminalRouteInfo {
+        size_t source;
+        size_t target;
+        RouteInfo route;
+    };
+
+    // The lightest route from any of sources to any of targets, found with
+    // one search instead of a search per pair
+    std::optional<TerminalRouteInfo> BuildRoute(std::span<const Terminal> sources,
+                                                std::span<const Terminal> targets) const;
+
+private:
+    struct VertexState {
+        Weight weight{};
+        std::optional<EdgeId> prev_edge;
+        bool reached = false;
+        bool settled = false;
+    };
+
+    // Min-heap ordered by weight, vertex id breaks ties deterministically
+    using QueueItem = std::pair<Weight, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    // Settles the top vertex of the queue and relaxes its edges, the vertex
+    // is empty for a stale queue item
+    std::optional<VertexId> SettleNext(std::vector<VertexState>& states, Queue& queue) const;
+    // Route along the prev edges to a settled vertex
+    RouteInfo MakeRoute(const std::vector<VertexState>& states, VertexId to) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph)
+    : graph_(graph)
+{
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (graph.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo> DijkstraRouter<Weight>::BuildRoute(
+    VertexId from, VertexId to) const {
+    const Terminal source{from, ZERO_WEIGHT};
+    const Terminal target{to, ZERO_WEIGHT};
+    if (auto built_route = BuildRoute(std::span(&source, 1), std::span(&target, 1))) {
+        return std::move(built_route->route);
+    }
+    return std::nullopt;
+}
+
+// Sources start with their weights, and a settled target offers its weight
+// plus the target weight. The search stops once no vertex left in the queue
+// can give a lighter route than the best one offered
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::TerminalRouteInfo> DijkstraRouter<Weight>::BuildRoute(
+    std::span<const Terminal> sources, std::span<const Terminal> targets) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    for (const auto& terminal : sources) {
+        if (terminal.vertex >= vertex_count) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+    }
+    for (const auto& terminal : targets) {
+        if (terminal.vertex >= vertex_count) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+    }
+
+    std::vector<VertexState> states(vertex_count);
+    Queue queue;
+
+    for (const auto& terminal : sources) {
+        auto& state = states[terminal.vertex];
+        if (!state.reached || terminal.weight < state.weight) {
+            state = VertexState{terminal.weight, std::nullopt, true, false};
+            queue.emplace(terminal.weight, terminal.vertex);
+        }
+    }
+
+    std::optional<size_t> best_target;
+    Weight best_weight{};
+    while (!queue.empty()) {
+        if (best_target && !(queue.top().first < best_weight)) {
+            break;
+        }
+        const auto vertex = SettleNext(states, queue);
+        if (!vertex) {
+            continue;
+        }
+
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (targets[i].vertex == *vertex) {
+                const Weight candidate_weight = states[*vertex].weight + targets[i].weight;
+                if (!best_target || candidate_weight < best_weight) {
+                    best_target = i;
+                    best_weight = candidate_weight;
+                }
+            }
+        }
+    }
+
+    if (!best_target) {
+        return std::nullopt;
+    }
+
+    const VertexId to = targets[*best_target].vertex;
+    RouteInfo route = MakeRoute(states, to);
+    const VertexId from = route.edges.empty() ? to : graph_.GetEdge(route.edges.front()).from;
+
+    // The route starts at the lightest source on its first vertex
+    size_t source = 0;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i].vertex == from && (sources[source].vertex != from || sources[i].weight < sources[source].weight)) {
+            source = i;
+        }
+    }
+
+    return TerminalRouteInfo{source, *best_target, std::move(route)};
+}
+
+// Vertices are settled in the order of the single pair search, so each
+// target gets the same prev edges and the same route
+template <typename Weight>
+std::vector<std::optional<typename DijkstraRouter<Weight>::RouteInfo>> DijkstraRouter<Weight>::BuildRoutes(
+    VertexId from, std::span<const VertexId> targets) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    std::vector<bool> is_target(vertex_count, false);
+    size_t targets_left = 0;
+    for (const VertexId target : targets) {
+        if (target >= vertex_count) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+        if (!is_target[target]) {
+            is_target[target] = true;
+            ++targets_left;
+        }
+    }
+
+    std::vector<VertexState> states(vertex_count);
+    Queue queue;
+    states[from] = VertexState{ZERO_WEIGHT, std::nullopt, true, false};
+    queue.emplace(ZERO_WEIGHT, from);
+
+    while (!queue.empty() && targets_left > 0) {
+        if (const auto vertex = SettleNext(states, queue); vertex && is_target[*vertex]) {
+            --targets_left;
+        }
+    }
+
+    std::vector<std::optional<RouteInfo>> routes;
+    routes.reserve(targets.size());
+    for (const VertexId target : targets) {
+        if (states[target].settled) {
+            routes.push_back(MakeRoute(states, target));
+        } else {
+            routes.push_back(std::nullopt);
+        }
+    }
+    return routes;
+}
+
+template <typename Weight>
+std::vector<std::optional<typename DijkstraRouter<Weight>::TreeItem>> DijkstraRouter<Weight>::BuildTree(
+    VertexId from) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    std::vector<VertexState> states(vertex_count);
+    Queue queue;
+    states[from] = VertexState{ZERO_WEIGHT, std::nullopt, true, false};
+    queue.emplace(ZERO_WEIGHT, from);
+    while (!queue.empty()) {
+        SettleNext(states, queue);
+    }
+
+    std::vector<std::optional<TreeItem>> tree(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        if (states[vertex].settled) {
+            tree[vertex] = TreeItem{states[vertex].weight, states[vertex].prev_edge};
+        }
+    }
+    return tree;
+}
+
+template <typename Weight>
+std::optional<VertexId> DijkstraRouter<Weight>::SettleNext(std::vector<VertexState>& states, Queue& queue) const {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+
+    auto& state = states[vertex];
+    if (state.settled) {
+        return std::nullopt;
+    }
+    state.settled = true;
+
+    for (const auto& edge : graph_.GetIncidentEdgesData(vertex)) {
+        auto& next = states[edge.to];
+        const Weight candidate_weight = weight + edge.weight;
+        if (!next.settled && (!next.reached || candidate_weight < next.weight)) {
+            next = VertexState{candidate_weight, edge.id, true, false};
+            queue.emplace(candidate_weight, edge.to);
+        }
+    }
+    return vertex;
+}
+
+template <typename Weight>
+typename DijkstraRouter<Weight>::RouteInfo DijkstraRouter<Weight>::MakeRoute(
+    const std::vector<VertexState>& states, VertexId to) const {
+    VertexId from = to;
+    std::vector<EdgeId> edges;
+    for (std::optional<EdgeId> edge_id = states[to].prev_edge;
+         edge_id;
+         edge_id = states[from].prev_edge)
+    {
+        edges.push_back(*edge_id);
+        from = graph_.GetEdge(*edge_id).from;
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    Weight route_weight = ZERO_WEIGHT;
+    for (const EdgeId edge_id : edges) {
+        route_weight = route_weight + graph_.GetEdge(edge_id).weight;
+    }
+    return RouteInfo{route_weight, std::move(edges)};
+}
+
+}  // namespace graph
@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "geo.h"
 
+// Dense indices of stops and buses in the order they were added, so that
+// per-stop and per-bus data can live in plain arrays
+using StopId = uint32_t;
+using BusId = uint32_t;
+
 struct Stop {
+    StopId id = 0;
     std::string name;
     geo::Coordinates coordinates;
 
@@ -18,8 +25,9 @@ struct Stop {
 };
 
 struct Bus {
+    BusId id = 0;
     std::string name;
-    std::vector<Stop*> stops;
+    std::vector<StopId> stops;
     bool is_roundtrip = false;
 
     Bus() = default;
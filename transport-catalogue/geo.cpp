@@ -1,5 +1,6 @@
 #define _USE_MATH_DEFINES
 
+#include <algorithm>
 #include <cmath>
 
 #include "geo.h"
@@ -28,9 +29,11 @@ std::ostream& operator<<(std::ostream& os, const Coordinates& c) {
 double ComputeDistance(Coordinates from, Coordinates to) {
     using namespace std;
     const double dr = M_PI / 180.0;
-    return acos(sin(from.lat * dr) * sin(to.lat * dr)
-                + cos(from.lat * dr) * cos(to.lat * dr) * cos(abs(from.lng - to.lng) * dr))
-        * 6371000;
+    // Rounding takes the cosine a little past 1 for equal and near points,
+    // where acos would give NaN
+    const double cos_angle = sin(from.lat * dr) * sin(to.lat * dr)
+                             + cos(from.lat * dr) * cos(to.lat * dr) * cos(abs(from.lng - to.lng) * dr);
+    return acos(clamp(cos_angle, -1.0, 1.0)) * EARTH_RADIUS;
 }
 
 }  // namespace geo
\ No newline at end of file
@@ -4,6 +4,9 @@
 
 namespace geo {
 
+// In meters
+inline constexpr double EARTH_RADIUS = 6371000;
+
 struct Coordinates {
     double lat;
     double lng;
@@ -2,14 +2,51 @@
 
 #include "ranges.h"
 
+#include <chrono>
+#include <cstddef>
 #include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 
 namespace graph {
 
 using VertexId = size_t;
 using EdgeId = size_t;
- 
+
+// Arithmetic representation of a weight for flat weight tables, with an
+// infinity sentinel marking unreachable vertices
+template <typename Weight>
+struct WeightTraits {
+    using Value = Weight;
+
+    static constexpr Value Infinity() {
+        return std::numeric_limits<Value>::infinity();
+    }
+    static constexpr Value ToValue(Weight weight) {
+        return weight;
+    }
+    static constexpr Weight FromValue(Value value) {
+        return value;
+    }
+};
+
+template <typename Rep, typename Period>
+struct WeightTraits<std::chrono::duration<Rep, Period>> {
+    using Value = Rep;
+
+    static constexpr Value Infinity() {
+        return std::numeric_limits<Value>::infinity();
+    }
+    static constexpr Value ToValue(std::chrono::duration<Rep, Period> weight) {
+        return weight.count();
+    }
+    static constexpr std::chrono::duration<Rep, Period> FromValue(Value value) {
+        return std::chrono::duration<Rep, Period>{value};
+    }
+};
+
 template <typename Weight>
 struct Edge {
     VertexId from;
@@ -17,42 +54,134 @@ struct Edge {
     Weight weight;
 };
 
+// Edges are appended to a builder list; Freeze() packs them into compressed
+// sparse row form (per-vertex offsets into one contiguous array of outgoing
+// edges), which is what traversal reads. Adding an edge unfreezes the graph.
 template <typename Weight>
 class DirectedWeightedGraph {
+public:
+    struct IncidentEdge {
+        EdgeId id;
+        VertexId to;
+        Weight weight;
+    };
+
 private:
-    using IncidenceList = std::vector<EdgeId>;
-    using IncidentEdgesRange = ranges::Range<typename IncidenceList::const_iterator>;
+    using IncidenceList = std::vector<IncidentEdge>;
+    using IncidentEdgesDataRange = ranges::Range<typename IncidenceList::const_iterator>;
+
+    class IncidentEdgeIdIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = EdgeId;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const EdgeId*;
+        using reference = const EdgeId&;
+
+        IncidentEdgeIdIterator() = default;
+        explicit IncidentEdgeIdIterator(typename IncidenceList::const_iterator it)
+            : it_(it) {
+        }
+
+        reference operator*() const {
+            return it_->id;
+        }
+        IncidentEdgeIdIterator& operator++() {
+            ++it_;
+            return *this;
+        }
+        IncidentEdgeIdIterator operator++(int) {
+            auto copy = *this;
+            ++it_;
+            return copy;
+        }
+        bool operator==(const IncidentEdgeIdIterator& other) const {
+            return it_ == other.it_;
+        }
+        bool operator!=(const IncidentEdgeIdIterator& other) const {
+            return it_ != other.it_;
+        }
+
+    private:
+        typename IncidenceList::const_iterator it_;
+    };
+
+    using IncidentEdgesRange = ranges::Range<IncidentEdgeIdIterator>;
 
 public:
     explicit DirectedWeightedGraph(size_t vertex_count);
     EdgeId AddEdge(const Edge<Weight>& edge);
 
+    void Freeze();
+    bool IsFrozen() const;
+
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
+
+    // Both ranges list a vertex's edges in the order they were added
+    // and require a frozen graph
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+    IncidentEdgesDataRange GetIncidentEdgesData(VertexId vertex) const;
 
 private:
+    void CheckFrozen(VertexId vertex) const;
+
+    size_t vertex_count_;
     std::vector<Edge<Weight>> edges_;
-    std::vector<IncidenceList> incidence_lists_;
+
+    bool is_frozen_ = false;
+    std::vector<size_t> incidence_offsets_;
+    IncidenceList incidence_list_;
 };
 
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {
+    : vertex_count_(vertex_count) {
 }
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    if (edge.from >= vertex_count_ || edge.to >= vertex_count_) {
+        throw std::out_of_range("Edge vertex is out of range");
+    }
     edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_.at(edge.from).push_back(id);
-    return id;
+    is_frozen_ = false;
+    return edges_.size() - 1;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Freeze() {
+    if (is_frozen_) {
+        return;
+    }
+
+    // Counting sort by source vertex; edges of one vertex keep their id order
+    incidence_offsets_.assign(vertex_count_ + 1, 0);
+    for (const auto& edge : edges_) {
+        ++incidence_offsets_[edge.from + 1];
+    }
+    for (size_t vertex = 0; vertex < vertex_count_; ++vertex) {
+        incidence_offsets_[vertex + 1] += incidence_offsets_[vertex];
+    }
+
+    incidence_list_.resize(edges_.size());
+    std::vector<size_t> positions(incidence_offsets_.begin(), incidence_offsets_.end() - 1);
+    for (EdgeId id = 0; id < edges_.size(); ++id) {
+        const auto& edge = edges_[id];
+        incidence_list_[positions[edge.from]++] = IncidentEdge{id, edge.to, edge.weight};
+    }
+    is_frozen_ = true;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return is_frozen_;
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
 }
 
 template <typename Weight>
@@ -68,6 +197,25 @@ const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
-    return ranges::AsRange(incidence_lists_.at(vertex));
+    const auto data = GetIncidentEdgesData(vertex);
+    return {IncidentEdgeIdIterator{data.begin()}, IncidentEdgeIdIterator{data.end()}};
+}
+
+template <typename Weight>
+typename DirectedWeightedGraph<Weight>::IncidentEdgesDataRange
+DirectedWeightedGraph<Weight>::GetIncidentEdgesData(VertexId vertex) const {
+    CheckFrozen(vertex);
+    return {incidence_list_.begin() + incidence_offsets_[vertex],
+            incidence_list_.begin() + incidence_offsets_[vertex + 1]};
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::CheckFrozen(VertexId vertex) const {
+    if (!is_frozen_) {
+        throw std::logic_error("Graph should be frozen before traversal");
+    }
+    if (vertex >= vertex_count_) {
+        throw std::out_of_range("Vertex is out of range");
+    }
 }
 }  // namespace graph
\ No newline at end of file
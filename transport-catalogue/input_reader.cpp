@@ -156,4 +156,5 @@ void InputReader::ApplyCommands([[maybe_unused]] TransportCatalogue& catalogue)
             catalogue.AddBus(id, ParseRoute(description));
         }
     }
+    catalogue.Finalize();
 }
@@ -1,6 +1,16 @@
 ﻿#include "json.h"
+#include "mapped_file.h"
 
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <iterator>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace json {
 
@@ -207,128 +217,660 @@ Node LoadNode(std::istream& input) {
     }
 }
 
-struct PrintContext {
-    std::ostream& out;
-    int indent_step = 4;
-    int indent = 0;
+bool IsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
 
-    void PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+// Whitespace as skipped by operator>>: space and \t \n \v \f \r
+const char* SkipSpaces(const char* pos, const char* end) {
+    if (pos != end && !IsSpace(*pos)) {
+        return pos;
+    }
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_range = _mm_set1_epi8('\r' - '\t');
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        // Unsigned c - '\t' <= '\r' - '\t' selects the control characters
+        const __m128i shifted = _mm_sub_epi8(chunk, tab);
+        const __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, control_range), shifted);
+        const __m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), is_control);
+        const unsigned others = ~static_cast<unsigned>(_mm_movemask_epi8(is_space)) & 0xFFFFu;
+        if (others != 0) {
+            return pos + std::countr_zero(others);
+        }
+    }
+#endif
+    while (pos != end && IsSpace(*pos)) {
+        ++pos;
+    }
+    return pos;
+}
+
+// First character a string can't copy as is: quote, backslash or line end
+const char* FindStringSpecial(const char* pos, const char* end) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i line_feed = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        const __m128i is_special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, line_feed), _mm_cmpeq_epi8(chunk, carriage_return)));
+        if (const auto mask = static_cast<unsigned>(_mm_movemask_epi8(is_special)); mask != 0) {
+            return pos + std::countr_zero(mask);
         }
     }
+#endif
+    while (pos != end && *pos != '"' && *pos != '\\' && *pos != '\n' && *pos != '\r') {
+        ++pos;
+    }
+    return pos;
+}
+
+// Recursive descent over [pos_, end_) mirroring the stream loaders above,
+// so both accept the same documents and throw the same errors. Values are
+// reported to the handler as they are parsed, nothing is kept in between.
+// A stream is read into buffer_ a chunk at a time, keeping only the token
+// being parsed when the buffer is refilled
+template <typename EventHandler>
+class EventParser {
+public:
+    EventParser(std::string_view text, EventHandler& handler)
+        : pos_(text.data())
+        , end_(text.data() + text.size())
+        , handler_(handler) {
+    }
 
-    PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
+    EventParser(std::istream& input, EventHandler& handler)
+        : pos_(nullptr)
+        , end_(nullptr)
+        , handler_(handler)
+        , input_(&input) {
     }
-};
 
-void PrintNode(const Node& value, const PrintContext& ctx);
+    void ParseNode() {
+        if (!SkipSpacesToNext()) {
+            throw ParsingError("Unexpected EOF"s);
+        }
+        switch (*pos_) {
+            case '[':
+                ++pos_;
+                ParseArray();
+                break;
+            case '{':
+                ++pos_;
+                ParseDict();
+                break;
+            case '"':
+                ++pos_;
+                handler_.OnString(ParseString());
+                break;
+            case 't':
+                [[fallthrough]];
+            case 'f':
+                ParseBool();
+                break;
+            case 'n':
+                ParseNull();
+                break;
+            default:
+                ParseNumber();
+                break;
+        }
+    }
 
-template <typename Value>
-void PrintValue(const Value& value, const PrintContext& ctx) {
-    ctx.out << value;
-}
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    // Moves [mark, end_) to the front of the buffer and reads the next chunk
+    // after it. False at the end of the input, or for a text
+    bool Refill(const char*& mark) {
+        if (input_ == nullptr || !*input_) {
+            return false;
+        }
+        const auto kept = static_cast<size_t>(end_ - mark);
+        const auto pos_offset = static_cast<size_t>(pos_ - mark);
+        if (kept > 0) {
+            std::memmove(buffer_.data(), mark, kept);
+        }
+        buffer_.resize(kept + CHUNK_SIZE);
+        input_->read(buffer_.data() + kept, static_cast<std::streamsize>(CHUNK_SIZE));
+        const auto read = static_cast<size_t>(input_->gcount());
+        buffer_.resize(kept + read);
+
+        mark = buffer_.data();
+        pos_ = mark + pos_offset;
+        end_ = mark + kept + read;
+        return read > 0;
+    }
+
+    // Whether a character is left at pos_, refilling the buffer from mark
+    bool HasMore(const char*& mark) {
+        return pos_ != end_ || Refill(mark);
+    }
+
+    // Skips whitespace and tells whether a character follows it
+    bool SkipSpacesToNext() {
+        while ((pos_ = SkipSpaces(pos_, end_)) == end_) {
+            if (!Refill(pos_)) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-void PrintString(const std::string& value, std::ostream& out) {
+    void ParseArray() {
+        handler_.OnStartArray();
+        while (true) {
+            if (!SkipSpacesToNext()) {
+                throw ParsingError("Array parsing error"s);
+            }
+            if (*pos_ == ']') {
+                ++pos_;
+                break;
+            }
+            if (*pos_ == ',') {
+                ++pos_;
+            }
+            ParseNode();
+        }
+        handler_.OnEndArray();
+    }
+
+    void ParseDict() {
+        handler_.OnStartDict();
+        while (true) {
+            if (!SkipSpacesToNext()) {
+                throw ParsingError("Dictionary parsing error"s);
+            }
+            const char c = *pos_++;
+            if (c == '}') {
+                break;
+            } else if (c == '"') {
+                std::string_view key = ParseString();
+                // Refilling the buffer before the colon would move the key
+                if (input_ != nullptr) {
+                    key_.assign(key);
+                    key = key_;
+                }
+                const bool has_next = SkipSpacesToNext();
+                if (!has_next || *pos_ != ':') {
+                    throw ParsingError(": is expected but '"s + (has_next ? *pos_ : c) + "' has been found"s);
+                }
+                ++pos_;
+                handler_.OnKey(key);
+                ParseNode();
+            } else if (c != ',') {
+                throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
+            }
+        }
+        handler_.OnEndDict();
+    }
+
+    // The opening quote is already consumed. Strings without escapes are
+    // returned as views into the text, others and those crossing the end of
+    // the buffer are copied into unescaped_. Either way the result is valid
+    // until the next string is parsed or the buffer is refilled
+    std::string_view ParseString() {
+        const char* run_end = FindStringSpecial(pos_, end_);
+        if (run_end != end_ && *run_end == '"') {
+            const std::string_view result(pos_, static_cast<size_t>(run_end - pos_));
+            pos_ = run_end + 1;
+            return result;
+        }
+
+        unescaped_.clear();
+        while (true) {
+            unescaped_.append(pos_, run_end);
+            pos_ = run_end;
+            if (pos_ == end_) {
+                if (!Refill(pos_)) {
+                    throw ParsingError("String parsing error");
+                }
+                run_end = FindStringSpecial(pos_, end_);
+                continue;
+            }
+
+            const char ch = *pos_++;
+            if (ch == '"') {
+                break;
+            } else if (ch != '\\') {
+                throw ParsingError("Unexpected end of line"s);
+            }
+
+            if (!HasMore(pos_)) {
+                throw ParsingError("String parsing error");
+            }
+            switch (const char escaped_char = *pos_++) {
+                case 'n':
+                    unescaped_.push_back('\n');
+                    break;
+                case 't':
+                    unescaped_.push_back('\t');
+                    break;
+                case 'r':
+                    unescaped_.push_back('\r');
+                    break;
+                case '"':
+                    unescaped_.push_back('"');
+                    break;
+                case '\\':
+                    unescaped_.push_back('\\');
+                    break;
+                default:
+                    throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+            }
+            run_end = FindStringSpecial(pos_, end_);
+        }
+        return unescaped_;
+    }
+
+    std::string_view ParseLiteral() {
+        const char* begin = pos_;
+        while (HasMore(begin) && std::isalpha(static_cast<unsigned char>(*pos_))) {
+            ++pos_;
+        }
+        return {begin, static_cast<size_t>(pos_ - begin)};
+    }
+
+    void ParseBool() {
+        const auto literal = ParseLiteral();
+        if (literal == "true"sv) {
+            handler_.OnBool(true);
+        } else if (literal == "false"sv) {
+            handler_.OnBool(false);
+        } else {
+            throw ParsingError("Failed to parse '"s + std::string(literal) + "' as bool"s);
+        }
+    }
+
+    void ParseNull() {
+        if (const auto literal = ParseLiteral(); literal == "null"sv) {
+            handler_.OnNull();
+        } else {
+            throw ParsingError("Failed to parse '"s + std::string(literal) + "' as null"s);
+        }
+    }
+
+    void ParseNumber() {
+        const char* begin = pos_;
+
+        auto skip_digits = [this, &begin] {
+            if (!HasMore(begin) || !IsDigit(*pos_)) {
+                throw ParsingError("A digit is expected"s);
+            }
+            while (HasMore(begin) && IsDigit(*pos_)) {
+                ++pos_;
+            }
+        };
+
+        if (HasMore(begin) && *pos_ == '-') {
+            ++pos_;
+        }
+        if (HasMore(begin) && *pos_ == '0') {
+            ++pos_;
+        } else {
+            skip_digits();
+        }
+
+        bool is_int = true;
+        if (HasMore(begin) && *pos_ == '.') {
+            ++pos_;
+            skip_digits();
+            is_int = false;
+        }
+
+        if (HasMore(begin) && (*pos_ == 'e' || *pos_ == 'E')) {
+            ++pos_;
+            if (HasMore(begin) && (*pos_ == '+' || *pos_ == '-')) {
+                ++pos_;
+            }
+            skip_digits();
+            is_int = false;
+        }
+
+        // Integers that don't fit into int are read as double, like stoi/stod do
+        if (is_int) {
+            int value;
+            if (const auto [ptr, ec] = std::from_chars(begin, pos_, value); ec == std::errc{}) {
+                handler_.OnInt(value);
+                return;
+            }
+        }
+        double value;
+        if (const auto [ptr, ec] = std::from_chars(begin, pos_, value); ec != std::errc{}) {
+            throw ParsingError("Failed to convert "s + std::string(begin, pos_) + " to number"s);
+        }
+        handler_.OnDouble(value);
+    }
+
+    const char* pos_;
+    const char* end_;
+    EventHandler& handler_;
+    std::string unescaped_;
+
+    // Only for a stream
+    std::istream* input_ = nullptr;
+    std::string buffer_;
+    std::string key_;
+};
+
+// Unescaped runs are written at once, which matters for long strings like maps
+void PrintString(std::string_view value, std::ostream& out) {
     out.put('"');
-    for (const char c : value) {
-        switch (c) {
+    size_t run_begin = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        std::string_view escaped;
+        switch (value[i]) {
             case '\r':
-                out << "\\r"sv;
+                escaped = "\\r"sv;
                 break;
             case '\n':
-                out << "\\n"sv;
+                escaped = "\\n"sv;
                 break;
             case '\t':
-                out << "\\t"sv;
+                escaped = "\\t"sv;
                 break;
             case '"':
-                [[fallthrough]];
+                escaped = "\\\""sv;
+                break;
             case '\\':
-                out.put('\\');
-                [[fallthrough]];
-            default:
-                out.put(c);
+                escaped = "\\\\"sv;
                 break;
+            default:
+                continue;
         }
+        out.write(value.data() + run_begin, static_cast<std::streamsize>(i - run_begin));
+        out << escaped;
+        run_begin = i + 1;
     }
+    out.write(value.data() + run_begin, static_cast<std::streamsize>(value.size() - run_begin));
     out.put('"');
 }
 
-template <>
-void PrintValue<std::string>(const std::string& value, const PrintContext& ctx) {
-    PrintString(value, ctx.out);
+}  // namespace
+
+Document Load(std::istream& input) {
+    return Document{LoadNode(input)};
 }
 
-template <>
-void PrintValue<std::nullptr_t>(const std::nullptr_t&, const PrintContext& ctx) {
-    ctx.out << "null"sv;
+Document Load(std::string_view text) {
+    DomBuilder builder;
+    EventParser(text, builder).ParseNode();
+    return Document{builder.Extract()};
 }
 
-template <>
-void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
-    ctx.out << (value ? "true"sv : "false"sv);
+void Parse(std::string_view text, Handler& handler) {
+    EventParser(text, handler).ParseNode();
 }
 
-template <>
-void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "[\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const Node& node : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintNode(node, inner_ctx);
+void Parse(std::istream& input, Handler& handler) {
+    EventParser(input, handler).ParseNode();
+}
+
+void ParseFile(const std::filesystem::path& file, Handler& handler) {
+    const MappedFile mapped_file(file);
+    Parse(mapped_file.GetData(), handler);
+}
+
+void DomBuilder::OnNull() {
+    AddValue(Node{nullptr});
+}
+
+void DomBuilder::OnBool(bool value) {
+    AddValue(Node{value});
+}
+
+void DomBuilder::OnInt(int value) {
+    AddValue(Node{value});
+}
+
+void DomBuilder::OnDouble(double value) {
+    AddValue(Node{value});
+}
+
+void DomBuilder::OnString(std::string_view value) {
+    AddValue(Node{std::string(value)});
+}
+
+void DomBuilder::OnStartArray() {
+    stack_.emplace_back(Array{});
+}
+
+void DomBuilder::OnEndArray() {
+    FinishContainer();
+}
+
+void DomBuilder::OnStartDict() {
+    stack_.emplace_back(Dict{});
+}
+
+void DomBuilder::OnKey(std::string_view key) {
+    using namespace std::literals;
+
+    keys_.emplace_back(key);
+    if (std::get<Dict>(stack_.back().GetValue()).count(keys_.back()) > 0) {
+        throw ParsingError("Duplicate key '"s + keys_.back() + "' have been found");
     }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put(']');
 }
 
-template <>
-void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "{\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const auto& [key, node] : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintString(key, ctx.out);
-        out << ": "sv;
-        PrintNode(node, inner_ctx);
+void DomBuilder::OnEndDict() {
+    FinishContainer();
+}
+
+bool DomBuilder::IsComplete() const {
+    return root_.has_value();
+}
+
+Node DomBuilder::Extract() {
+    using namespace std::literals;
+
+    if (!root_) {
+        throw std::logic_error("Document is incomplete"s);
     }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put('}');
+    Node root = std::move(*root_);
+    root_.reset();
+    return root;
 }
 
-void PrintNode(const Node& node, const PrintContext& ctx) {
-    std::visit(
-        [&ctx](const auto& value) {
-            PrintValue(value, ctx);
-        },
-        node.GetValue());
+void DomBuilder::AddValue(Node value) {
+    if (stack_.empty()) {
+        root_.emplace(std::move(value));
+        return;
+    }
+
+    auto& container = stack_.back().GetValue();
+    if (std::holds_alternative<Array>(container)) {
+        std::get<Array>(container).push_back(std::move(value));
+    } else {
+        std::get<Dict>(container).emplace(std::move(keys_.back()), std::move(value));
+        keys_.pop_back();
+    }
 }
 
-}  // namespace
+void DomBuilder::FinishContainer() {
+    Node container = std::move(stack_.back());
+    stack_.pop_back();
+    AddValue(std::move(container));
+}
 
-Document Load(std::istream& input) {
-    return Document{LoadNode(input)};
+Document LoadFile(const std::filesystem::path& file) {
+    const MappedFile mapped_file(file);
+    return Load(mapped_file.GetData());
 }
 
 void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{output});
+    Writer(output).Value(doc.GetRoot());
+}
+
+Writer::Writer(std::ostream& output)
+    : out_(output) {
+}
+
+Writer::Writer(std::ostream& output, size_t depth)
+    : out_(output)
+    , base_depth_(depth) {
+}
+
+Writer& Writer::StartDict() {
+    BeforeValue();
+    out_ << "{\n"sv;
+    levels_.push_back(Level{true, true});
+    return *this;
+}
+
+Writer& Writer::EndDict() {
+    using namespace std::literals;
+
+    if (levels_.empty() || !levels_.back().is_dict || has_key_) {
+        throw std::logic_error("EndDict outside of a dict or after a key"s);
+    }
+    EndContainer('}');
+    return *this;
+}
+
+Writer& Writer::StartArray() {
+    BeforeValue();
+    out_ << "[\n"sv;
+    levels_.push_back(Level{false, true});
+    return *this;
+}
+
+Writer& Writer::EndArray() {
+    using namespace std::literals;
+
+    if (levels_.empty() || levels_.back().is_dict) {
+        throw std::logic_error("EndArray outside of an array"s);
+    }
+    EndContainer(']');
+    return *this;
+}
+
+Writer& Writer::Key(std::string_view key) {
+    using namespace std::literals;
+
+    if (levels_.empty() || !levels_.back().is_dict || has_key_) {
+        throw std::logic_error("Key outside of a dict or after another key"s);
+    }
+    StartItem();
+    PrintString(key, out_);
+    out_ << ": "sv;
+    has_key_ = true;
+    return *this;
+}
+
+Writer& Writer::Value(std::nullptr_t) {
+    BeforeValue();
+    out_ << "null"sv;
+    return *this;
+}
+
+Writer& Writer::Value(bool value) {
+    BeforeValue();
+    out_ << (value ? "true"sv : "false"sv);
+    return *this;
+}
+
+Writer& Writer::Value(int value) {
+    BeforeValue();
+    out_ << value;
+    return *this;
+}
+
+Writer& Writer::Value(double value) {
+    BeforeValue();
+    out_ << value;
+    return *this;
+}
+
+Writer& Writer::Value(std::string_view value) {
+    BeforeValue();
+    PrintString(value, out_);
+    return *this;
+}
+
+Writer& Writer::Value(const char* value) {
+    return Value(std::string_view(value));
+}
+
+Writer& Writer::RawValue(std::string_view json) {
+    BeforeValue();
+    out_ << json;
+    return *this;
+}
+
+Writer& Writer::Value(const Node& node) {
+    if (node.IsArray()) {
+        StartArray();
+        for (const Node& item : node.AsArray()) {
+            Value(item);
+        }
+        EndArray();
+    } else if (node.IsDict()) {
+        StartDict();
+        for (const auto& [key, item] : node.AsDict()) {
+            Key(key);
+            Value(item);
+        }
+        EndDict();
+    } else {
+        std::visit(
+            [this](const auto& value) {
+                using Type = std::decay_t<decltype(value)>;
+                if constexpr (std::is_same_v<Type, std::string>) {
+                    Value(std::string_view(value));
+                } else if constexpr (!std::is_same_v<Type, Array> && !std::is_same_v<Type, Dict>) {
+                    Value(value);
+                }
+            },
+            node.GetValue());
+    }
+    return *this;
+}
+
+void Writer::BeforeValue() {
+    using namespace std::literals;
+
+    if (levels_.empty()) {
+        return;
+    }
+    if (levels_.back().is_dict) {
+        if (!has_key_) {
+            throw std::logic_error("Dict value without a key"s);
+        }
+        has_key_ = false;
+    } else {
+        StartItem();
+    }
+}
+
+void Writer::StartItem() {
+    if (!levels_.back().is_empty) {
+        out_ << ",\n"sv;
+    }
+    levels_.back().is_empty = false;
+    PrintIndent(base_depth_ + levels_.size());
+}
+
+void Writer::EndContainer(char bracket) {
+    levels_.pop_back();
+    out_.put('\n');
+    PrintIndent(base_depth_ + levels_.size());
+    out_.put(bracket);
+}
+
+void Writer::PrintIndent(size_t depth) {
+    for (size_t i = 0; i < depth * INDENT_STEP; ++i) {
+        out_.put(' ');
+    }
 }
 
 Node& Node::operator=(Node&& other) noexcept {
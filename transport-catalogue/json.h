@@ -1,8 +1,11 @@
 ﻿#pragma once
 
+#include <filesystem>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -82,8 +85,113 @@ inline bool operator!=(const Document& lhs, const Document& rhs) {
     return !(lhs == rhs);
 }
 
+// Receives values in document order from Parse. Keys and strings are only
+// valid during the call, handlers copy what they keep
+class Handler {
+public:
+    virtual ~Handler() = default;
+
+    virtual void OnNull() = 0;
+    virtual void OnBool(bool value) = 0;
+    virtual void OnInt(int value) = 0;
+    virtual void OnDouble(double value) = 0;
+    virtual void OnString(std::string_view value) = 0;
+
+    virtual void OnStartArray() = 0;
+    virtual void OnEndArray() = 0;
+
+    // Every key is followed by its value
+    virtual void OnStartDict() = 0;
+    virtual void OnKey(std::string_view key) = 0;
+    virtual void OnEndDict() = 0;
+};
+
+// Collects events into a Node, e.g. to keep a part of a streamed document
+class DomBuilder final : public Handler {
+public:
+    void OnNull() override;
+    void OnBool(bool value) override;
+    void OnInt(int value) override;
+    void OnDouble(double value) override;
+    void OnString(std::string_view value) override;
+    void OnStartArray() override;
+    void OnEndArray() override;
+    void OnStartDict() override;
+    void OnKey(std::string_view key) override;
+    void OnEndDict() override;
+
+    // True once a whole value has been received
+    bool IsComplete() const;
+    Node Extract();
+
+private:
+    void AddValue(Node value);
+    void FinishContainer();
+
+    std::vector<Node> stack_;
+    std::vector<std::string> keys_;
+    std::optional<Node> root_;
+};
+
 Document Load(std::istream& input);
+// Same grammar and errors as Load(std::istream&), scanning a contiguous buffer
+Document Load(std::string_view text);
+// Parses a memory-mapped file with Load(std::string_view)
+Document LoadFile(const std::filesystem::path& file);
+
+// Event-driven counterparts of Load(std::string_view) and LoadFile,
+// no document is built. Errors are the same ParsingError exceptions
+void Parse(std::string_view text, Handler& handler);
+void ParseFile(const std::filesystem::path& file, Handler& handler);
+// Reads the stream in chunks of a fixed size, so that the whole text is
+// never in memory at once
+void Parse(std::istream& input, Handler& handler);
 
 void Print(const Document& doc, std::ostream& output);
 
+// Prints values as they come, with the same layout and escaping as Print,
+// so large outputs don't need a Document. Dict keys are printed in the
+// order given, Print sorts them
+class Writer {
+public:
+    explicit Writer(std::ostream& output);
+    // Indents as if depth containers were open, for a value printed on its
+    // own and spliced into an outer document with RawValue
+    Writer(std::ostream& output, size_t depth);
+
+    Writer& StartDict();
+    Writer& EndDict();
+    Writer& StartArray();
+    Writer& EndArray();
+    Writer& Key(std::string_view key);
+
+    Writer& Value(std::nullptr_t);
+    Writer& Value(bool value);
+    Writer& Value(int value);
+    Writer& Value(double value);
+    Writer& Value(std::string_view value);
+    Writer& Value(const char* value);
+    Writer& Value(const Node& node);
+    // Text printed by a Writer at the depth of this value
+    Writer& RawValue(std::string_view json);
+
+private:
+    static constexpr size_t INDENT_STEP = 4;
+
+    struct Level {
+        bool is_dict;
+        bool is_empty;
+    };
+
+    void BeforeValue();
+    void StartItem();
+    void EndContainer(char bracket);
+    void PrintIndent(size_t depth);
+
+    std::ostream& out_;
+    size_t base_depth_ = 0;
+    std::vector<Level> levels_;
+    bool has_key_ = false;
+};
+
 }  // namespace json
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "json_flat.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace json::flat {
+
+using namespace std::literals;
+
+Dict::Dict(const Member* members, size_t size)
+    : members_(members)
+    , size_(size) {
+}
+
+Dict::const_iterator Dict::begin() const {
+    return members_;
+}
+
+Dict::const_iterator Dict::end() const {
+    return members_ + size_;
+}
+
+size_t Dict::size() const {
+    return size_;
+}
+
+bool Dict::empty() const {
+    return size_ == 0;
+}
+
+Dict::const_iterator Dict::find(std::string_view key) const {
+    const auto it = std::lower_bound(begin(), end(), key, [](const Member& member, std::string_view key) {
+        return member.key < key;
+    });
+    return it != end() && it->key == key ? it : end();
+}
+
+size_t Dict::count(std::string_view key) const {
+    return find(key) != end() ? 1 : 0;
+}
+
+const Node& Dict::at(std::string_view key) const {
+    const auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("Key '"s + std::string(key) + "' is not found"s);
+    }
+    return it->value;
+}
+
+bool Node::IsInt() const {
+    return type_ == Type::INT;
+}
+int Node::AsInt() const {
+    if (!IsInt()) {
+        throw std::logic_error("Not an int"s);
+    }
+    return int_;
+}
+
+bool Node::IsPureDouble() const {
+    return type_ == Type::DOUBLE;
+}
+bool Node::IsDouble() const {
+    return IsInt() || IsPureDouble();
+}
+double Node::AsDouble() const {
+    if (!IsDouble()) {
+        throw std::logic_error("Not a double"s);
+    }
+    return IsPureDouble() ? double_ : int_;
+}
+
+bool Node::IsBool() const {
+    return type_ == Type::BOOL;
+}
+bool Node::AsBool() const {
+    if (!IsBool()) {
+        throw std::logic_error("Not a bool"s);
+    }
+    return bool_;
+}
+
+bool Node::IsNull() const {
+    return type_ == Type::NUL;
+}
+
+bool Node::IsArray() const {
+    return type_ == Type::ARRAY;
+}
+Array Node::AsArray() const {
+    if (!IsArray()) {
+        throw std::logic_error("Not an array"s);
+    }
+    return {items_, size_};
+}
+
+bool Node::IsString() const {
+    return type_ == Type::STRING;
+}
+std::string_view Node::AsString() const {
+    if (!IsString()) {
+        throw std::logic_error("Not a string"s);
+    }
+    return {chars_, size_};
+}
+
+bool Node::IsDict() const {
+    return type_ == Type::DICT;
+}
+Dict Node::AsDict() const {
+    if (!IsDict()) {
+        throw std::logic_error("Not a dict"s);
+    }
+    return {members_, size_};
+}
+
+std::string_view Arena::CopyString(std::string_view str) {
+    char* chars = Allocate<char>(str.size());
+    std::copy(str.begin(), str.end(), chars);
+    return {chars, str.size()};
+}
+
+void* Arena::AllocateBytes(size_t size, size_t alignment) {
+    const size_t padding = reinterpret_cast<uintptr_t>(position_) % alignment == 0
+        ? 0
+        : alignment - reinterpret_cast<uintptr_t>(position_) % alignment;
+    if (position_ == nullptr || available_ < padding + size) {
+        // Big arrays get a block of their own
+        const size_t block_size = std::max(BLOCK_SIZE, size + alignment);
+        blocks_.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+        position_ = blocks_.back().get();
+        available_ = block_size;
+        return AllocateBytes(size, alignment);
+    }
+
+    void* result = position_ + padding;
+    position_ += padding + size;
+    available_ -= padding + size;
+    return result;
+}
+
+const Node& Document::GetRoot() const {
+    return root_;
+}
+
+Builder::Builder(std::string_view source)
+    : source_(source) {
+}
+
+void Builder::OnNull() {
+    AddValue(Node{});
+}
+
+void Builder::OnBool(bool value) {
+    Node node;
+    node.type_ = Node::Type::BOOL;
+    node.bool_ = value;
+    AddValue(node);
+}
+
+void Builder::OnInt(int value) {
+    Node node;
+    node.type_ = Node::Type::INT;
+    node.int_ = value;
+    AddValue(node);
+}
+
+void Builder::OnDouble(double value) {
+    Node node;
+    node.type_ = Node::Type::DOUBLE;
+    node.double_ = value;
+    AddValue(node);
+}
+
+void Builder::OnString(std::string_view value) {
+    const auto kept = KeepString(value);
+    Node node;
+    node.type_ = Node::Type::STRING;
+    node.size_ = kept.size();
+    node.chars_ = kept.data();
+    AddValue(node);
+}
+
+void Builder::OnStartArray() {
+    frames_.push_back(Frame{false, items_.size()});
+}
+
+void Builder::OnEndArray() {
+    const size_t begin = frames_.back().begin;
+    frames_.pop_back();
+
+    Node node;
+    node.type_ = Node::Type::ARRAY;
+    node.size_ = items_.size() - begin;
+    Node* items = arena_.Allocate<Node>(node.size_);
+    std::copy(items_.begin() + begin, items_.end(), items);
+    node.items_ = items;
+    items_.resize(begin);
+    AddValue(node);
+}
+
+void Builder::OnStartDict() {
+    frames_.push_back(Frame{true, members_.size()});
+}
+
+void Builder::OnKey(std::string_view key) {
+    keys_.push_back(KeepString(key));
+}
+
+// Duplicates are found after sorting, so a document with several errors may
+// report the duplicate key later than json::Load does
+void Builder::OnEndDict() {
+    const size_t begin = frames_.back().begin;
+    frames_.pop_back();
+
+    const auto members_begin = members_.begin() + static_cast<std::ptrdiff_t>(begin);
+    std::sort(members_begin, members_.end(), [](const Member& lhs, const Member& rhs) {
+        return lhs.key < rhs.key;
+    });
+    const auto duplicate = std::adjacent_find(members_begin, members_.end(), [](const Member& lhs, const Member& rhs) {
+        return lhs.key == rhs.key;
+    });
+    if (duplicate != members_.end()) {
+        throw ParsingError("Duplicate key '"s + std::string(duplicate->key) + "' have been found");
+    }
+
+    Node node;
+    node.type_ = Node::Type::DICT;
+    node.size_ = members_.size() - begin;
+    Member* members = arena_.Allocate<Member>(node.size_);
+    std::copy(members_begin, members_.end(), members);
+    node.members_ = members;
+    members_.resize(begin);
+    AddValue(node);
+}
+
+bool Builder::IsComplete() const {
+    return is_complete_;
+}
+
+Document Builder::Extract() {
+    if (!is_complete_) {
+        throw std::logic_error("Document is incomplete"s);
+    }
+
+    Document document;
+    document.arena_ = std::move(arena_);
+    document.root_ = root_;
+    arena_ = Arena{};
+    root_ = Node{};
+    is_complete_ = false;
+    return document;
+}
+
+std::string_view Builder::KeepString(std::string_view str) {
+    const std::less<const char*> less;
+    const char* source_end = source_.data() + source_.size();
+    if (!less(str.data(), source_.data()) && !less(source_end, str.data() + str.size())) {
+        return str;
+    }
+    return arena_.CopyString(str);
+}
+
+void Builder::AddValue(const Node& value) {
+    if (frames_.empty()) {
+        root_ = value;
+        is_complete_ = true;
+    } else if (frames_.back().is_dict) {
+        members_.push_back(Member{keys_.back(), value});
+        keys_.pop_back();
+    } else {
+        items_.push_back(value);
+    }
+}
+
+}  // namespace json::flat
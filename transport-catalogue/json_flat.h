@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+// Read-only JSON tree for large request documents. Nodes are small trivially
+// copyable records allocated in the document's arena, dicts are arrays of
+// (key, node) members sorted by key. Strings without escapes point into the
+// source text given to the Builder instead of being copied, the others and
+// all strings of a document built without a source live in the arena.
+namespace json::flat {
+
+class Node;
+struct Member;
+class Builder;
+
+using Array = std::span<const Node>;
+
+// Sorted members with the lookup part of the std::map interface
+class Dict {
+public:
+    using const_iterator = const Member*;
+
+    Dict() = default;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+    // Throws std::out_of_range for a missing key, like std::map::at
+    const Node& at(std::string_view key) const;
+
+private:
+    friend class Node;
+
+    Dict(const Member* members, size_t size);
+
+    const Member* members_ = nullptr;
+    size_t size_ = 0;
+};
+
+class Node {
+public:
+    Node() = default;
+
+    bool IsInt() const;
+    int AsInt() const;
+
+    bool IsPureDouble() const;
+    bool IsDouble() const;
+    double AsDouble() const;
+
+    bool IsBool() const;
+    bool AsBool() const;
+
+    bool IsNull() const;
+
+    bool IsArray() const;
+    Array AsArray() const;
+
+    bool IsString() const;
+    std::string_view AsString() const;
+
+    bool IsDict() const;
+    Dict AsDict() const;
+
+private:
+    friend class Builder;
+
+    enum class Type : uint8_t {
+        NUL,
+        BOOL,
+        INT,
+        DOUBLE,
+        STRING,
+        ARRAY,
+        DICT,
+    };
+
+    Type type_ = Type::NUL;
+    // Length of a string, count of array items or dict members
+    size_t size_ = 0;
+    union {
+        bool bool_;
+        int int_;
+        double double_;
+        const char* chars_;
+        const Node* items_;
+        const Member* members_ = nullptr;
+    };
+};
+
+struct Member {
+    std::string_view key;
+    Node value;
+};
+
+// Bump allocator for trivially destructible objects, freed all at once
+class Arena {
+public:
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    template <typename T>
+    T* Allocate(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return static_cast<T*>(AllocateBytes(count * sizeof(T), alignof(T)));
+    }
+
+    std::string_view CopyString(std::string_view str);
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    void* AllocateBytes(size_t size, size_t alignment);
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* position_ = nullptr;
+    size_t available_ = 0;
+};
+
+class Document {
+public:
+    Document() = default;
+
+    const Node& GetRoot() const;
+
+private:
+    friend class Builder;
+
+    Arena arena_;
+    Node root_;
+};
+
+// Builds a Document from json::Parse events. Strings lying inside source are
+// referenced in place, the others are copied to the arena, so source must
+// outlive the document
+class Builder final : public Handler {
+public:
+    explicit Builder(std::string_view source = {});
+
+    void OnNull() override;
+    void OnBool(bool value) override;
+    void OnInt(int value) override;
+    void OnDouble(double value) override;
+    void OnString(std::string_view value) override;
+    void OnStartArray() override;
+    void OnEndArray() override;
+    void OnStartDict() override;
+    void OnKey(std::string_view key) override;
+    void OnEndDict() override;
+
+    // True once a whole value has been received
+    bool IsComplete() const;
+    Document Extract();
+
+private:
+    struct Frame {
+        bool is_dict;
+        // First item of the container in items_ or members_
+        size_t begin;
+    };
+
+    std::string_view KeepString(std::string_view str);
+    void AddValue(const Node& value);
+
+    std::string_view source_;
+    Arena arena_;
+
+    // Items of the open containers, moved to the arena when they are closed
+    std::vector<Frame> frames_;
+    std::vector<Node> items_;
+    std::vector<Member> members_;
+    std::vector<std::string_view> keys_;
+
+    Node root_;
+    bool is_complete_ = false;
+};
+
+}  // namespace json::flat
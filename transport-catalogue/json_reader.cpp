@@ -1,9 +1,225 @@
 #include "json_reader.h"
 
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+
 using namespace std;
 
+namespace {
+
+// Splits the document into top-level sections: stat_requests go to a flat
+// document, the others are kept as nodes. With a catalogue, base_requests are
+// not kept: stops are added as soon as each request is parsed, while
+// distances and buses may name stops that come later, so they wait for the
+// end of base_requests and are applied in document order, like FillCatalogue.
+// Strings of stat_requests lying in source are not copied, see json_flat.h
+class SectionsHandler final : public json::Handler {
+public:
+    SectionsHandler(
+        TransportCatalogue* catalogue,
+        vector<tuple<string_view, string_view, double>>& distances,
+        string_view source = {}
+    )
+        : catalogue_(catalogue)
+        , distances_(distances)
+        , source_(source) {
+    }
+
+    void OnNull() override {
+        OnValue([](json::Handler& handler) { handler.OnNull(); });
+    }
+    void OnBool(bool value) override {
+        OnValue([value](json::Handler& handler) { handler.OnBool(value); });
+    }
+    void OnInt(int value) override {
+        OnValue([value](json::Handler& handler) { handler.OnInt(value); });
+    }
+    void OnDouble(double value) override {
+        OnValue([value](json::Handler& handler) { handler.OnDouble(value); });
+    }
+    void OnString(string_view value) override {
+        OnValue([value](json::Handler& handler) { handler.OnString(value); });
+    }
+
+    void OnStartArray() override {
+        if (!capture_ && catalogue_ && depth_ == ROOT_DEPTH && key_ == "base_requests"sv) {
+            depth_ = BASE_REQUESTS_DEPTH;
+            return;
+        }
+        OnValue([](json::Handler& handler) { handler.OnStartArray(); });
+    }
+
+    void OnEndArray() override {
+        if (!capture_ && depth_ == BASE_REQUESTS_DEPTH) {
+            depth_ = ROOT_DEPTH;
+            ApplyPendingRequests();
+            return;
+        }
+        Forward([](json::Handler& handler) { handler.OnEndArray(); });
+    }
+
+    void OnStartDict() override {
+        if (!capture_ && depth_ == 0) {
+            depth_ = ROOT_DEPTH;
+            return;
+        }
+        OnValue([](json::Handler& handler) { handler.OnStartDict(); });
+    }
+
+    void OnKey(string_view key) override {
+        if (capture_) {
+            capture_->OnKey(key);
+            return;
+        }
+        key_ = key;
+        if (!seen_keys_.insert(key_).second) {
+            throw json::ParsingError("Duplicate key '"s + key_ + "' have been found");
+        }
+    }
+
+    void OnEndDict() override {
+        if (!capture_ && depth_ == ROOT_DEPTH) {
+            depth_ = 0;
+            return;
+        }
+        Forward([](json::Handler& handler) { handler.OnEndDict(); });
+    }
+
+    json::Dict ExtractSections() {
+        return std::move(sections_);
+    }
+
+    json::flat::Document ExtractStatRequests() {
+        return std::move(stat_requests_);
+    }
+
+private:
+    static constexpr int ROOT_DEPTH = 1;
+    static constexpr int BASE_REQUESTS_DEPTH = 2;
+
+    struct PendingBus {
+        string name;
+        vector<string> stops;
+        bool is_roundtrip;
+    };
+
+    // A value at the root level or in base_requests starts a new capture
+    template <typename Event>
+    void OnValue(Event event) {
+        if (!capture_) {
+            if (depth_ == 0) {
+                throw logic_error("Not a dict"s);
+            } else if (depth_ == ROOT_DEPTH && key_ == "stat_requests"sv) {
+                capture_ = &flat_capture_.emplace(source_);
+            } else {
+                capture_ = &dom_capture_.emplace();
+            }
+        }
+        Forward(event);
+    }
+
+    template <typename Event>
+    void Forward(Event event) {
+        event(*capture_);
+        if (flat_capture_ && flat_capture_->IsComplete()) {
+            stat_requests_ = flat_capture_->Extract();
+            flat_capture_.reset();
+            capture_ = nullptr;
+        } else if (dom_capture_ && dom_capture_->IsComplete()) {
+            json::Node node = dom_capture_->Extract();
+            dom_capture_.reset();
+            capture_ = nullptr;
+            if (depth_ == BASE_REQUESTS_DEPTH) {
+                AddRequest(node.AsDict());
+            } else {
+                sections_.emplace(key_, std::move(node));
+            }
+        }
+    }
+
+    void AddRequest(const json::Dict& request) {
+        const auto& type = request.at("type").AsString();
+        if (type == "Stop") {
+            const auto& name = request.at("name").AsString();
+            auto lat = request.at("latitude").AsDouble();
+            auto lng = request.at("longitude").AsDouble();
+            catalogue_->AddStop(name, geo::Coordinates{lat, lng});
+            for (const auto& [stop, distance] : request.at("road_distances").AsDict()) {
+                pending_distances_.emplace_back(name, stop, distance.AsInt());
+            }
+        } else if (type == "Bus") {
+            PendingBus bus{request.at("name").AsString(), {}, request.at("is_roundtrip").AsBool()};
+            for (const auto& stop : request.at("stops").AsArray()) {
+                bus.stops.push_back(stop.AsString());
+            }
+            pending_buses_.push_back(std::move(bus));
+        }
+    }
+
+    void ApplyPendingRequests() {
+        for (const auto& [from, to, distance] : pending_distances_) {
+            catalogue_->SetStopsDistance(from, to, distance);
+            const Stop* from_stop = catalogue_->GetStop(from);
+            const Stop* to_stop = catalogue_->GetStop(to);
+            if (from_stop && to_stop) {
+                distances_.emplace_back(from_stop->name, to_stop->name, distance);
+            }
+        }
+        pending_distances_.clear();
+
+        for (const auto& bus : pending_buses_) {
+            catalogue_->AddBus(bus.name, vector<string_view>(bus.stops.begin(), bus.stops.end()), bus.is_roundtrip);
+        }
+        pending_buses_.clear();
+        catalogue_->Finalize();
+    }
+
+    TransportCatalogue* catalogue_;
+    vector<tuple<string_view, string_view, double>>& distances_;
+    string_view source_;
+
+    int depth_ = 0;
+    string key_;
+    unordered_set<string> seen_keys_;
+
+    // Points to the engaged one of the two builders while a section is parsed
+    json::Handler* capture_ = nullptr;
+    optional<json::DomBuilder> dom_capture_;
+    optional<json::flat::Builder> flat_capture_;
+
+    json::Dict sections_;
+    json::flat::Document stat_requests_;
+
+    vector<tuple<string, string, int>> pending_distances_;
+    vector<PendingBus> pending_buses_;
+};
+
+}  // namespace
+
 JsonReader::JsonReader(istream& is)
-    : document_(json::Load(is)) {
+    : document_(nullptr) {
+    SectionsHandler handler(nullptr, distances_);
+    json::Parse(is, handler);
+    document_ = json::Document(handler.ExtractSections());
+    stat_requests_ = handler.ExtractStatRequests();
+}
+
+JsonReader::JsonReader(istream& is, TransportCatalogue& catalogue)
+    : document_(nullptr) {
+    SectionsHandler handler(&catalogue, distances_);
+    json::Parse(is, handler);
+    document_ = json::Document(handler.ExtractSections());
+    stat_requests_ = handler.ExtractStatRequests();
+}
+
+JsonReader::JsonReader(const filesystem::path& file, TransportCatalogue& catalogue)
+    : document_(nullptr) {
+    file_ = make_unique<const MappedFile>(file);
+    SectionsHandler handler(&catalogue, distances_, file_->GetData());
+    json::Parse(file_->GetData(), handler);
+    document_ = json::Document(handler.ExtractSections());
+    stat_requests_ = handler.ExtractStatRequests();
 }
 
 const json::Node& JsonReader::GetRoot() const {
@@ -14,10 +230,11 @@ void JsonReader::FillCatalogue(TransportCatalogue& catalogue) {
     AddStops(catalogue);
     AddStopsDistances(catalogue);
     AddRoutes(catalogue);
+    catalogue.Finalize();
 }
 
-const json::Array& JsonReader::GetStatRequests() const {
-    return document_.GetRoot().AsDict().at("stat_requests").AsArray();
+json::flat::Array JsonReader::GetStatRequests() const {
+    return stat_requests_.GetRoot().AsArray();
 }
 
 const json::Dict& JsonReader::GetRenderSettings() const {
@@ -28,6 +245,10 @@ const json::Dict& JsonReader::GetRoutingSettings() const {
     return document_.GetRoot().AsDict().at("routing_settings").AsDict();
 }
 
+const json::Dict& JsonReader::GetSerializationSettings() const {
+    return document_.GetRoot().AsDict().at("serialization_settings").AsDict();
+}
+
 void JsonReader::AddStops(TransportCatalogue& catalogue) {
     for (const auto& request : document_.GetRoot().AsDict().at("base_requests").AsArray()) {
         if (request.AsDict().at("type").AsString() == "Stop") {
@@ -42,7 +263,7 @@ void JsonReader::AddStops(TransportCatalogue& catalogue) {
 void JsonReader::AddStopsDistances(TransportCatalogue& catalogue) {
     for (const auto& request : document_.GetRoot().AsDict().at("base_requests").AsArray()) {
         if (request.AsDict().at("type").AsString() == "Stop") {
-            auto name = request.AsDict().at("name").AsString();
+            const auto& name = request.AsDict().at("name").AsString();
             for (auto& [stop, distance] : request.AsDict().at("road_distances").AsDict()) {
                 catalogue.SetStopsDistance(name, stop, distance.AsInt());
                 distances_.push_back(std::make_tuple(name, stop, distance.AsInt()));
@@ -1,19 +1,32 @@
 #pragma once
 
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include "json.h"
+#include "json_flat.h"
+#include "mapped_file.h"
 #include "transport_catalogue.h"
 
 class JsonReader {
     public:
     JsonReader() = delete;
     JsonReader(std::istream& is);
+    // Stream base_requests into the catalogue one request at a time instead of
+    // keeping them in the document, so FillCatalogue isn't needed (and the
+    // base_requests section isn't available) afterwards
+    JsonReader(std::istream& is, TransportCatalogue& catalogue);
+    // The file stays mapped while the reader lives, and strings of the stat
+    // requests point into it
+    JsonReader(const std::filesystem::path& file, TransportCatalogue& catalogue);
 
     void FillCatalogue(TransportCatalogue& catalogue);
 
-    const json::Array& GetStatRequests() const;
+    // Kept in a flat document, see json_flat.h
+    json::flat::Array GetStatRequests() const;
     const json::Dict& GetRenderSettings() const;
     const json::Dict& GetRoutingSettings() const;
+    const json::Dict& GetSerializationSettings() const;
 
     const std::vector<std::tuple<std::string_view, std::string_view, double>>& GetDistances() const;
 
@@ -21,6 +34,9 @@ class JsonReader {
 
 private:
     json::Document document_;
+    // Declared before stat_requests_, which may point into it
+    std::unique_ptr<const MappedFile> file_;
+    json::flat::Document stat_requests_;
 
     std::vector<std::tuple<std::string_view, std::string_view, double>> distances_;
 
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Thread-safe map of at most capacity values, which drops the least recently
+// used value to make room for a new one. A cache of zero capacity keeps
+// nothing and counts nothing
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t size = 0;
+    };
+
+    explicit LruCache(size_t capacity = 0)
+        : capacity_(capacity) {
+    }
+
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    // A copy of the value, which becomes the most recently used
+    std::optional<Value> Find(const Key& key) {
+        if (capacity_ == 0) {
+            return std::nullopt;
+        }
+        std::lock_guard lock(mutex_);
+        const auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++misses_;
+            return std::nullopt;
+        }
+        ++hits_;
+        items_.splice(items_.begin(), items_, it->second);
+        return it->second->second;
+    }
+
+    void Put(const Key& key, Value value) {
+        if (capacity_ == 0) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        if (const auto it = index_.find(key); it != index_.end()) {
+            it->second->second = std::move(value);
+            items_.splice(items_.begin(), items_, it->second);
+            return;
+        }
+        if (items_.size() == capacity_) {
+            index_.erase(items_.back().first);
+            items_.pop_back();
+        }
+        items_.emplace_front(key, std::move(value));
+        index_.emplace(key, items_.begin());
+    }
+
+    void Clear() {
+        std::lock_guard lock(mutex_);
+        items_.clear();
+        index_.clear();
+    }
+
+    Stats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return Stats{hits_, misses_, items_.size()};
+    }
+
+private:
+    using Item = std::pair<Key, Value>;
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    // Most recently used first
+    std::list<Item> items_;
+    std::unordered_map<Key, typename std::list<Item>::iterator, Hash> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
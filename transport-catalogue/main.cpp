@@ -1,27 +1,105 @@
 #include <iostream>
+#include <filesystem>
 #include <fstream>
+#include <string_view>
+#include <thread>
 
+#include "catalogue_view.h"
 #include "json_reader.h"
 #include "request_handler.h"
+#include "serialization.h"
 
-int main() {
-    using namespace std::literals;
+using namespace std::literals;
+
+namespace {
+
+void PrintUsage(std::ostream& stream = std::cerr) {
+    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+}
+
+// Builds the catalogue and routes from base_requests and saves them
+// to serialization_settings.file, and to mapped_file when it is set.
+// Settings that can't be saved are reported before anything is written
+bool MakeBase(std::istream& input) {
+    TransportCatalogue catalogue;
+    JsonReader reader(input, catalogue);
+
+    const auto settings = serialization::AsSerializationSettings(reader.GetSerializationSettings());
+    if (settings.mapped_file && AsRouterMode(reader.GetRoutingSettings()) == RouterMode::ON_DEMAND) {
+        std::cerr << "mapped_file needs route tables, which the on_demand router_mode does not keep\n"sv;
+        return false;
+    }
+
+    MapRenderer renderer(reader.GetRenderSettings());
+    TransportRouter router(catalogue, reader.GetRoutingSettings());
+
+    serialization::SaveBase(settings.file, catalogue, renderer.GetRenderSettings(), router);
+
+    if (settings.mapped_file) {
+        SaveCatalogueView(*settings.mapped_file, catalogue, router, renderer.GetMap(catalogue));
+    }
+    return true;
+}
+
+// Answers stat_requests from the base saved by MakeBase, straight from
+// the mapped snapshot when mapped_file is set
+void ProcessRequests(std::istream& input, std::ostream& output) {
+    JsonReader reader(input);
+    const auto settings = serialization::AsSerializationSettings(reader.GetSerializationSettings());
+
+    if (settings.mapped_file) {
+        const CatalogueView view(*settings.mapped_file);
+        RequestHandler handler(view);
+        handler.SetThreadCount(std::thread::hardware_concurrency());
+        handler.PrintRequestsResponce(reader.GetStatRequests(), output);
+        return;
+    }
+
+    TransportCatalogue catalogue;
+    RenderSettings render_settings;
+    auto router = serialization::LoadBase(settings.file, catalogue, render_settings);
+
+    MapRenderer renderer(std::move(render_settings));
+    RequestHandler handler(catalogue, renderer, *router);
+    handler.SetThreadCount(std::thread::hardware_concurrency());
+    handler.PrintRequestsResponce(reader.GetStatRequests(), output);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc == 2) {
+        const std::string_view mode(argv[1]);
+        if (mode == "make_base"sv) {
+            if (!MakeBase(std::cin)) {
+                return 1;
+            }
+        } else if (mode == "process_requests"sv) {
+            ProcessRequests(std::cin, std::cout);
+        } else {
+            PrintUsage();
+            return 1;
+        }
+        return 0;
+    } else if (argc != 1) {
+        PrintUsage();
+        return 1;
+    }
 
     TransportCatalogue catalogue;
 
-    std::ifstream fin("tests//input.json");
-    JsonReader reader(fin);
+    JsonReader reader(std::filesystem::path("tests//input.json"), catalogue);
 
-    // JsonReader reader(std::cin);
-    reader.FillCatalogue(catalogue);
+    // JsonReader reader(std::cin, catalogue);
 
     MapRenderer renderer(reader.GetRenderSettings());
     TransportRouter router(catalogue, reader.GetRoutingSettings());
 
     RequestHandler handler(catalogue, renderer, router);
+    handler.SetThreadCount(std::thread::hardware_concurrency());
 
     std::ofstream fout("tests//output.json");
     handler.PrintRequestsResponce(reader.GetStatRequests(), fout);
 
     // handler.PrintRequestsResponce(reader.GetStatRequests(), std::cout);
-}
\ No newline at end of file
+}
@@ -1,6 +1,9 @@
 #include "map_renderer.h"
+#include <stdexcept>
 #include <unordered_map>
 
+using namespace std::literals;
+
 bool IsZero(double value) {
     return std::abs(value) < EPSILON;
 }
@@ -14,12 +17,21 @@ svg::Point SphereProjector::operator()(geo::Coordinates coords) const {
 
 void MapRenderer::SetRenderSettings(const json::Dict& settings) {
     settings_.SetRenderSettings(settings);
+    InvalidateMap();
 }
 
 MapRenderer::MapRenderer(const json::Dict& settings) {
     settings_.SetRenderSettings(settings);
 }
 
+MapRenderer::MapRenderer(RenderSettings settings)
+    : settings_(std::move(settings)) {
+}
+
+const RenderSettings& MapRenderer::GetRenderSettings() const {
+    return settings_;
+}
+
 svg::Color AsColor(json::Node color) {
     if (color.IsArray()) {
         if (color.AsArray().size() == 3) {
@@ -80,6 +92,34 @@ void MapRenderer::Render(std::ostream& out) const {
 }
 
 void MapRenderer::RenderAll(const TransportCatalogue& catalogue, std::ostream& out) {
+    out << GetMap(catalogue);
+}
+
+const std::string& MapRenderer::GetMap(const TransportCatalogue& catalogue) {
+    std::lock_guard lock(cache_mutex_);
+    if (map_catalogue_ == &catalogue && map_version_ == catalogue.GetVersion()) {
+        return map_;
+    }
+
+    SphereProjector projector = MakeProjector(catalogue);
+
+    // Objects of an earlier render must not be drawn again
+    document_.Clear();
+    RenderBusesLines(catalogue, projector);
+    RenderBusesNames(catalogue, projector);
+    RenderStopsPoints(catalogue, projector);
+    RenderStopsNames(catalogue, projector);
+
+    svg::OutputBuffer out;
+    document_.Render(out);
+    map_ = out.Extract();
+    map_catalogue_ = &catalogue;
+    map_version_ = catalogue.GetVersion();
+    return map_;
+}
+
+// Stops without buses are not drawn and do not count for the bounds
+SphereProjector MapRenderer::MakeProjector(const TransportCatalogue& catalogue) const {
     struct CoordinatesHash {
         std::size_t operator()(const geo::Coordinates& coords) const {
             return std::hash<double>()(coords.lat) ^ std::hash<double>()(coords.lng);
@@ -93,21 +133,294 @@ void MapRenderer::RenderAll(const TransportCatalogue& catalogue, std::ostream& o
             stops_coordinates.emplace(stop->coordinates);
         }
     }
-    
-    SphereProjector projector(
-        stops_coordinates.begin(), 
+
+    return SphereProjector(
+        stops_coordinates.begin(),
         stops_coordinates.end(),
         settings_.width_,
         settings_.height_,
         settings_.padding_
     );
+}
 
-    RenderBusesLines(catalogue, projector);
-    RenderBusesNames(catalogue, projector);
-    RenderStopsPoints(catalogue, projector);
-    RenderStopsNames(catalogue, projector);
+std::string MapRenderer::RenderTile(const TransportCatalogue& catalogue, int z, int x, int y) {
+    if (!HasTile(z, x, y)) {
+        throw std::invalid_argument("No tile "s + std::to_string(z) + "/"s + std::to_string(x) + "/"s + std::to_string(y));
+    }
 
-    document_.Render(out);
+    const double scale = static_cast<double>(1 << z);
+    const double tile_width = settings_.width_ / scale;
+    const double tile_height = settings_.height_ / scale;
+    const spatial::Box window{
+        x * tile_width,
+        y * tile_height,
+        (x + 1) * tile_width,
+        (y + 1) * tile_height
+    };
+    return RenderWindow(*GetLayout(catalogue), window, scale);
+}
+
+bool MapRenderer::HasTile(int z, int x, int y) {
+    constexpr int MAX_ZOOM = 30;
+    return z >= 0 && z <= MAX_ZOOM && x >= 0 && y >= 0 && x < (1 << z) && y < (1 << z);
+}
+
+std::string MapRenderer::RenderViewport(const TransportCatalogue& catalogue,
+                                        geo::Coordinates first_corner,
+                                        geo::Coordinates second_corner) {
+    const auto layout = GetLayout(catalogue);
+    const svg::Point first = layout->projector(first_corner);
+    const svg::Point second = layout->projector(second_corner);
+    const spatial::Box window{
+        std::min(first.x, second.x),
+        std::min(first.y, second.y),
+        std::max(first.x, second.x),
+        std::max(first.y, second.y)
+    };
+
+    // A zero-sized side does not limit the scale
+    std::optional<double> scale;
+    if (!IsZero(window.max_x - window.min_x)) {
+        scale = settings_.width_ / (window.max_x - window.min_x);
+    }
+    if (!IsZero(window.max_y - window.min_y)) {
+        const double height_scale = settings_.height_ / (window.max_y - window.min_y);
+        scale = scale ? std::min(*scale, height_scale) : height_scale;
+    }
+    return RenderWindow(*layout, window, scale.value_or(1.0));
+}
+
+// Lines, bus names, stops and stop names follow the order of the full map
+std::shared_ptr<const MapRenderer::Layout> MapRenderer::GetLayout(const TransportCatalogue& catalogue) {
+    std::lock_guard lock(cache_mutex_);
+    if (layout_ && layout_catalogue_ == &catalogue && layout_version_ == catalogue.GetVersion()) {
+        return layout_;
+    }
+
+    SphereProjector projector = MakeProjector(catalogue);
+    const spatial::Box bounds{0, 0, settings_.width_, settings_.height_};
+
+    auto buses_names = catalogue.GetBusesNames();
+    std::sort(buses_names.begin(), buses_names.end());
+
+    std::vector<Layout::Line> lines;
+    size_t segments_count = 0;
+    for (size_t i = 0; i < buses_names.size(); ++i) {
+        const Bus* bus = catalogue.GetBus(buses_names[i]);
+        Layout::Line line{bus, i, {}};
+        for (const StopId stop : bus->stops) {
+            line.points.push_back(projector(catalogue.GetStop(stop)->coordinates));
+        }
+        if (!bus->is_roundtrip) {
+            for (auto it = bus->stops.rbegin() + 1; it < bus->stops.rend(); ++it) {
+                line.points.push_back(projector(catalogue.GetStop(*it)->coordinates));
+            }
+        }
+        segments_count += line.points.size();
+        lines.push_back(std::move(line));
+    }
+
+    size_t max_bus_name_size = 0;
+    for (const auto& line : lines) {
+        max_bus_name_size = std::max(max_bus_name_size, line.bus->name.size());
+    }
+
+    spatial::GridIndex<Layout::Segment> segments(bounds, segments_count);
+    spatial::GridIndex<Layout::Label> bus_labels(bounds, 2 * lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const auto& points = lines[i].points;
+        for (size_t j = 0; j + 1 < points.size(); ++j) {
+            spatial::Box box = spatial::Box::Around(points[j].x, points[j].y);
+            box.Extend(spatial::Box::Around(points[j + 1].x, points[j + 1].y));
+            segments.Insert(box, Layout::Segment{i, j});
+        }
+        // A single stop still makes a one-point line
+        if (points.size() == 1) {
+            segments.Insert(spatial::Box::Around(points[0].x, points[0].y), Layout::Segment{i, 0});
+        }
+
+        const Bus* bus = lines[i].bus;
+        if (bus->stops.empty()) {
+            continue;
+        }
+        const svg::Point start = projector(catalogue.GetStop(bus->stops.front())->coordinates);
+        bus_labels.Insert(spatial::Box::Around(start.x, start.y), Layout::Label{i, start});
+        if (!bus->is_roundtrip && bus->stops.front() != bus->stops.back()) {
+            const svg::Point end = projector(catalogue.GetStop(bus->stops.back())->coordinates);
+            bus_labels.Insert(spatial::Box::Around(end.x, end.y), Layout::Label{i, end});
+        }
+    }
+
+    auto stops_names = catalogue.GetStopsNames();
+    std::sort(stops_names.begin(), stops_names.end());
+    spatial::GridIndex<Layout::StopMark> stops(bounds, stops_names.size());
+    size_t max_stop_name_size = 0;
+    for (const auto& stop_name : stops_names) {
+        const Stop* stop = catalogue.GetStop(stop_name);
+        if (!catalogue.GetBusesByStop(stop).empty()) {
+            const svg::Point position = projector(stop->coordinates);
+            stops.Insert(spatial::Box::Around(position.x, position.y), Layout::StopMark{stop, position});
+            max_stop_name_size = std::max(max_stop_name_size, stop->name.size());
+        }
+    }
+
+    layout_ = std::make_shared<const Layout>(Layout{
+        std::move(projector),
+        std::move(lines),
+        std::move(segments),
+        std::move(bus_labels),
+        std::move(stops),
+        max_bus_name_size,
+        max_stop_name_size
+    });
+    layout_catalogue_ = &catalogue;
+    layout_version_ = catalogue.GetVersion();
+    return layout_;
+}
+
+// Text takes at most a font size per byte of the name, an ascent of a font
+// size above the baseline and a quarter of it below, and the underlayer
+// stroke around all of it
+spatial::Box MapRenderer::GetLabelBox(svg::Point position, svg::Point offset, int font_size, size_t name_size, double scale) const {
+    const double stroke = settings_.underlayer_width_ / 2;
+    return {
+        position.x + (offset.x - stroke) / scale,
+        position.y + (offset.y - font_size - stroke) / scale,
+        position.x + (offset.x + static_cast<double>(font_size) * static_cast<double>(name_size) + stroke) / scale,
+        position.y + (offset.y + font_size / 4.0 + stroke) / scale
+    };
+}
+
+// Runs of segments of one line that cross the window become polylines of
+// their own. Shapes are drawn unscaled, so their sizes are divided by scale
+// in full map coordinates. Labels are kept while their estimated box crosses
+// the window, and a label near a tile edge is drawn in every tile it reaches,
+// each of them showing its own part
+std::string MapRenderer::RenderWindow(const Layout& layout, const spatial::Box& window, double scale) const {
+    const auto to_window = [&window, scale](svg::Point point) {
+        return svg::Point{(point.x - window.min_x) * scale, (point.y - window.min_y) * scale};
+    };
+    const auto& palette = settings_.color_palette_;
+    svg::CompactDocument document;
+
+    std::optional<svg::Polyline> run;
+    size_t run_line = 0, run_end = 0;
+    const auto flush_run = [&document, &run]() {
+        if (run) {
+            document.Add(*run);
+            run.reset();
+        }
+    };
+    layout.segments.ForEachIntersecting(window.Expanded(settings_.line_width_ / 2 / scale), [&](const Layout::Segment& segment) {
+        const auto& points = layout.lines[segment.line].points;
+        if (!run || run_line != segment.line || run_end != segment.first_point) {
+            flush_run();
+            run = svg::Polyline()
+                .SetFillColor("none")
+                .SetStrokeColor(palette[layout.lines[segment.line].color_index % palette.size()])
+                .SetStrokeWidth(settings_.line_width_)
+                .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+            run->AddPoint(to_window(points[segment.first_point]));
+        }
+        if (segment.first_point + 1 < points.size()) {
+            run->AddPoint(to_window(points[segment.first_point + 1]));
+        }
+        run_line = segment.line;
+        run_end = segment.first_point + 1;
+    });
+    flush_run();
+
+    // Anchors of labels that may reach the window lie in the window moved
+    // back by the box of the widest label
+    const auto labels_window = [&window](const spatial::Box& widest) {
+        return spatial::Box{window.min_x - widest.max_x, window.min_y - widest.max_y,
+                            window.max_x - widest.min_x, window.max_y - widest.min_y};
+    };
+
+    const auto bus_label_box = [&](svg::Point position, size_t name_size) {
+        return GetLabelBox(position, settings_.bus_label_offset_, settings_.bus_label_font_size_, name_size, scale);
+    };
+    const auto bus_labels_window = labels_window(bus_label_box({0, 0}, layout.max_bus_name_size));
+    layout.bus_labels.ForEachIntersecting(bus_labels_window, [&](const Layout::Label& label) {
+        const Layout::Line& line = layout.lines[label.line];
+        if (!bus_label_box(label.position, line.bus->name.size()).Intersects(window)) {
+            return;
+        }
+        document.Add(svg::Text()
+            .SetFillColor(settings_.underlayer_color_)
+            .SetStrokeColor(settings_.underlayer_color_)
+            .SetStrokeWidth(settings_.underlayer_width_)
+            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
+            .SetFontSize(static_cast<uint32_t>(settings_.bus_label_font_size_))
+            .SetFontFamily("Verdana")
+            .SetFontWeight("bold")
+            .SetOffset(settings_.bus_label_offset_)
+            .SetPosition(to_window(label.position))
+            .SetData(line.bus->name));
+        document.Add(svg::Text()
+            .SetFillColor(palette[line.color_index % palette.size()])
+            .SetFontSize(static_cast<uint32_t>(settings_.bus_label_font_size_))
+            .SetFontFamily("Verdana")
+            .SetFontWeight("bold")
+            .SetOffset(settings_.bus_label_offset_)
+            .SetPosition(to_window(label.position))
+            .SetData(line.bus->name));
+    });
+
+    // A stop is drawn with its label when either of them crosses the window
+    const double stop_radius = settings_.stop_radius_ / scale;
+    const auto stop_label_box = [&](svg::Point position, size_t name_size) {
+        return GetLabelBox(position, settings_.stop_label_offset_, settings_.stop_label_font_size_, name_size, scale);
+    };
+    spatial::Box stops_window = labels_window(stop_label_box({0, 0}, layout.max_stop_name_size));
+    stops_window.Extend(window.Expanded(stop_radius));
+    std::vector<Layout::StopMark> stops;
+    layout.stops.ForEachIntersecting(stops_window, [&](const Layout::StopMark& mark) {
+        const bool is_visible = spatial::Box::Around(mark.position.x, mark.position.y).Expanded(stop_radius).Intersects(window)
+            || stop_label_box(mark.position, mark.stop->name.size()).Intersects(window);
+        if (is_visible) {
+            stops.push_back(mark);
+        }
+    });
+    for (const auto& mark : stops) {
+        document.Add(svg::Circle()
+            .SetCenter(to_window(mark.position))
+            .SetRadius(settings_.stop_radius_)
+            .SetFillColor("white"));
+    }
+    for (const auto& mark : stops) {
+        document.Add(svg::Text()
+            .SetFillColor(settings_.underlayer_color_)
+            .SetStrokeColor(settings_.underlayer_color_)
+            .SetStrokeWidth(settings_.underlayer_width_)
+            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
+            .SetPosition(to_window(mark.position))
+            .SetOffset(settings_.stop_label_offset_)
+            .SetFontSize(static_cast<uint32_t>(settings_.stop_label_font_size_))
+            .SetFontFamily("Verdana")
+            .SetData(mark.stop->name));
+        document.Add(svg::Text()
+            .SetFillColor("black")
+            .SetPosition(to_window(mark.position))
+            .SetOffset(settings_.stop_label_offset_)
+            .SetFontSize(static_cast<uint32_t>(settings_.stop_label_font_size_))
+            .SetFontFamily("Verdana")
+            .SetData(mark.stop->name));
+    }
+
+    svg::OutputBuffer out;
+    document.Render(out);
+    return out.Extract();
+}
+
+void MapRenderer::InvalidateMap() {
+    std::lock_guard lock(cache_mutex_);
+    map_.clear();
+    map_catalogue_ = nullptr;
+    layout_.reset();
 }
 
 void MapRenderer::RenderBusesLines(const TransportCatalogue& catalogue, SphereProjector& pr) {
@@ -119,13 +432,13 @@ void MapRenderer::RenderBusesLines(const TransportCatalogue& catalogue, SpherePr
     for (const auto& bus_name : buss_names) {
         auto bus = catalogue.GetBus(bus_name);
         buss_coordinates.emplace_back(std::vector<geo::Coordinates>());
-        for (const auto& stop : bus->stops) {
-            buss_coordinates.back().emplace_back(stop->coordinates);
+        for (const StopId stop : bus->stops) {
+            buss_coordinates.back().emplace_back(catalogue.GetStop(stop)->coordinates);
         }
 
         if (!bus->is_roundtrip) {
             for (auto it = bus->stops.rbegin() + 1; it < bus->stops.rend(); ++it) {
-                buss_coordinates.back().emplace_back((*it)->coordinates);
+                buss_coordinates.back().emplace_back(catalogue.GetStop(*it)->coordinates);
             }
         }
     }
@@ -175,7 +488,7 @@ void MapRenderer::RenderBusesNames(const TransportCatalogue& catalogue, SpherePr
             .SetOffset(settings_.bus_label_offset_)
             .SetData(bus->name);
         
-        auto start_coords = pr(bus->stops[0]->coordinates);
+        auto start_coords = pr(catalogue.GetStop(bus->stops[0])->coordinates);
         bus_name_stroke.SetPosition(start_coords);
         bus_name.SetPosition(start_coords);
 
@@ -183,7 +496,7 @@ void MapRenderer::RenderBusesNames(const TransportCatalogue& catalogue, SpherePr
         document_.Add(bus_name);
 
         if (!bus->is_roundtrip && bus->stops.front() != bus->stops.back()) {
-            auto end_coords = pr(bus->stops.back()->coordinates);
+            auto end_coords = pr(catalogue.GetStop(bus->stops.back())->coordinates);
             bus_name_stroke.SetPosition(end_coords);
             bus_name.SetPosition(end_coords);
 
@@ -2,10 +2,15 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 
 #include "svg.h"
 #include "json.h"
+#include "spatial_index.h"
 #include "transport_catalogue.h"
 
 inline const double EPSILON = 1e-6;
@@ -89,8 +94,10 @@ class MapRenderer {
 public:
     MapRenderer() = default;
     MapRenderer(const json::Dict& settings);
+    MapRenderer(RenderSettings settings);
 
     void SetRenderSettings(const json::Dict& settings);
+    const RenderSettings& GetRenderSettings() const;
 
     void RenderBusesLines(const TransportCatalogue& catalogue, SphereProjector& projector);
     void RenderBusesNames(const TransportCatalogue& catalogue, SphereProjector& projector);
@@ -99,7 +106,75 @@ public:
     void RenderAll(const TransportCatalogue& catalogue, std::ostream& out);
     void Render(std::ostream& out) const;
 
+    // The map is rendered once per catalogue version and render settings,
+    // later calls return the same text. GetMap, RenderTile and RenderViewport
+    // may be called from several threads while the catalogue and the settings
+    // do not change
+    const std::string& GetMap(const TransportCatalogue& catalogue);
+
+    // The full map split into 2^z by 2^z tiles, tile x, y is drawn scaled
+    // to width by height. Throws std::invalid_argument for a missing tile
+    std::string RenderTile(const TransportCatalogue& catalogue, int z, int x, int y);
+    // Zoom goes up to 30, so that 2^z fits an int
+    static bool HasTile(int z, int x, int y);
+    // The area between two corners, scaled to fit width by height
+    std::string RenderViewport(const TransportCatalogue& catalogue, geo::Coordinates first_corner, geo::Coordinates second_corner);
+
 private:
+    // Projected geometry of the full map with grid indexes over it, so that
+    // a tile only looks at the shapes it crosses
+    struct Layout {
+        struct Line {
+            const Bus* bus;
+            size_t color_index;
+            std::vector<svg::Point> points;
+        };
+        // From points[first_point] to the next point of the line
+        struct Segment {
+            size_t line;
+            size_t first_point;
+        };
+        struct Label {
+            size_t line;
+            svg::Point position;
+        };
+        struct StopMark {
+            const Stop* stop;
+            svg::Point position;
+        };
+
+        SphereProjector projector;
+        std::vector<Line> lines;
+        spatial::GridIndex<Segment> segments;
+        spatial::GridIndex<Label> bus_labels;
+        spatial::GridIndex<StopMark> stops;
+        // In bytes, for the widest label a window has to look for
+        size_t max_bus_name_size = 0;
+        size_t max_stop_name_size = 0;
+    };
+
+    SphereProjector MakeProjector(const TransportCatalogue& catalogue) const;
+    // Kept alive by the caller while another thread may replace it
+    std::shared_ptr<const Layout> GetLayout(const TransportCatalogue& catalogue);
+    // Draws the shapes crossing window, a box in full map coordinates,
+    // moved to the origin and multiplied by scale
+    std::string RenderWindow(const Layout& layout, const spatial::Box& window, double scale) const;
+    // Estimated box of a label at position, in full map coordinates, when its
+    // text is drawn unscaled in a window of the given scale
+    spatial::Box GetLabelBox(svg::Point position, svg::Point offset, int font_size, size_t name_size, double scale) const;
+    void InvalidateMap();
+
     RenderSettings settings_;
-    svg::Document document_;
+    svg::CompactDocument document_;
+
+    // Guards document_ and the caches below
+    std::mutex cache_mutex_;
+
+    std::string map_;
+    const TransportCatalogue* map_catalogue_ = nullptr;
+    uint64_t map_version_ = 0;
+
+    std::shared_ptr<const Layout> layout_;
+    const TransportCatalogue* layout_catalogue_ = nullptr;
+    uint64_t layout_version_ = 0;
 };
\ No newline at end of file
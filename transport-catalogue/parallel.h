@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// Calls function(index) for every index below count on thread_count threads,
+// the calling thread included. Each thread starts with an equal range of
+// indices and takes them from its front. A thread that runs out steals the
+// back half of the largest range left, so that a few slow tasks do not keep
+// the others idle. function must not throw
+template <typename Function>
+void ForEachIndex(size_t count, size_t thread_count, Function function) {
+    thread_count = std::clamp<size_t>(thread_count, 1, std::max<size_t>(count, 1));
+    if (thread_count == 1) {
+        for (size_t index = 0; index < count; ++index) {
+            function(index);
+        }
+        return;
+    }
+
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+    std::vector<Range> ranges(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        ranges[i].begin = count * i / thread_count;
+        ranges[i].end = count * (i + 1) / thread_count;
+    }
+
+    // Only one range is locked at a time. A stolen half is not in any range
+    // until the thief puts it into its own, and nobody else needs it
+    auto take = [&ranges](size_t worker, size_t& index) {
+        {
+            std::lock_guard lock(ranges[worker].mutex);
+            if (ranges[worker].begin < ranges[worker].end) {
+                index = ranges[worker].begin++;
+                return true;
+            }
+        }
+
+        while (true) {
+            size_t victim = worker;
+            size_t victim_size = 0;
+            for (size_t i = 0; i < ranges.size(); ++i) {
+                std::lock_guard lock(ranges[i].mutex);
+                if (ranges[i].end - ranges[i].begin > victim_size) {
+                    victim = i;
+                    victim_size = ranges[i].end - ranges[i].begin;
+                }
+            }
+            if (victim_size == 0) {
+                return false;
+            }
+
+            size_t stolen_begin = 0;
+            size_t stolen_end = 0;
+            {
+                std::lock_guard lock(ranges[victim].mutex);
+                const size_t size = ranges[victim].end - ranges[victim].begin;
+                if (size == 0) {
+                    continue;
+                }
+                stolen_end = ranges[victim].end;
+                stolen_begin = stolen_end - (size + 1) / 2;
+                ranges[victim].end = stolen_begin;
+            }
+
+            std::lock_guard lock(ranges[worker].mutex);
+            ranges[worker].begin = stolen_begin + 1;
+            ranges[worker].end = stolen_end;
+            index = stolen_begin;
+            return true;
+        }
+    };
+
+    auto worker = [&take, &function](size_t id) {
+        size_t index = 0;
+        while (take(id, index)) {
+            function(index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t id = 1; id < thread_count; ++id) {
+        threads.emplace_back(worker, id);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+}  // namespace parallel
@@ -1,185 +1,404 @@
 #include "request_handler.h"    
 #include "json_reader.h"
+#include "parallel.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string_view>
+#include <thread>
 
 using namespace std::literals;
 
+namespace {
+
+// A stop name or {"latitude": ..., "longitude": ...}, empty for anything else
+std::optional<RoutePoint> AsRoutePoint(const json::flat::Node& node) {
+    if (node.IsString()) {
+        return node.AsString();
+    }
+    if (!node.IsDict()) {
+        return std::nullopt;
+    }
+    const auto place = node.AsDict();
+    if (!place.count("latitude") || !place.at("latitude").IsDouble()
+        || !place.count("longitude") || !place.at("longitude").IsDouble()) {
+        return std::nullopt;
+    }
+    return geo::Coordinates{place.at("latitude").AsDouble(), place.at("longitude").AsDouble()};
+}
+
+bool IsPlace(const RoutePoint& point) {
+    return std::holds_alternative<geo::Coordinates>(point);
+}
+
+}  // namespace
+
 RequestHandler::RequestHandler(const TransportCatalogue& catalogue, MapRenderer& renderer, const TransportRouter& router)
-    : catalogue_(catalogue)
-    , renderer_(renderer)
-    , router_(router) {
+    : queries_(std::make_unique<BuiltCatalogueQueries>(catalogue, renderer, router)) {
+}
+
+RequestHandler::RequestHandler(const CatalogueView& view)
+    : queries_(std::make_unique<MappedCatalogueQueries>(view)) {
 }
 
 std::optional<BusStat> RequestHandler::GetBusStat(std::string_view route_name) const {
-    return catalogue_.GetBusStat(route_name);
+    return queries_->GetBusStat(route_name);
 }
 
-std::unordered_set<Bus*> RequestHandler::GetBusesByStop(std::string_view stop_name) const {
-    return catalogue_.GetBusesByStop(catalogue_.GetStop(stop_name));
+std::optional<std::vector<std::string_view>> RequestHandler::FindStopBuses(std::string_view stop_name) const {
+    return queries_->FindStopBuses(stop_name);
 }
 
-json::Node RequestHandler::GetStopRequestResponce(int id, const std::string& name) const {
-    auto stop = catalogue_.GetStop(name);
-    if (stop == nullptr) {
-        return json::Builder{}
-            .StartDict()
-                .Key("error_message"s).Value("not found"s)
-                .Key("request_id"s).Value(id)
-            .EndDict()
-        .Build();
-    } else {
-        std::vector<std::string> buses_names;
-        for (auto& bus : catalogue_.GetBusesByStop(stop)) {
-            buses_names.emplace_back(bus->name);
-        }
-        std::sort(buses_names.begin(), buses_names.end());
+// Keys are written in alphabetical order, as json::Print orders dict keys
+void RequestHandler::PrintError(json::Writer& writer, int id, std::string_view message) const {
+    writer.StartDict()
+        .Key("error_message"sv).Value(message)
+        .Key("request_id"sv).Value(id)
+    .EndDict();
+}
 
-        json::Array sorted_buses;
-        for (const auto& bus_name : buses_names) {
-            sorted_buses.emplace_back(bus_name);
-        }
-        return json::Builder{}
-            .StartDict()
-                .Key("buses"s).Value(sorted_buses)
-                .Key("request_id"s).Value(id)
-            .EndDict()
-        .Build();
-    }
-}
-
-json::Node RequestHandler::GetBusRequestResponce(int id, const std::string& name) const {
-    if (auto stat = GetBusStat(name)) {
-        return json::Builder{}
-            .StartDict()
-                .Key("curvature"s).Value(stat->curvature)
-                .Key("stop_count"s).Value(stat->stop_count)
-                .Key("unique_stop_count"s).Value(stat->unique_stop_count)
-                .Key("route_length"s).Value(stat->bus_length)
-                .Key("request_id"s).Value(id)
-            .EndDict()
-        .Build();
-    }
-    return json::Builder{}
-        .StartDict()
-            .Key("error_message"s).Value("not found"s)
-            .Key("request_id"s).Value(id)
-        .EndDict()
-    .Build();
-}
-
-json::Node RequestHandler::GetRouteRquestResponce(int id, Route route) const {
+void RequestHandler::PrintNotFound(json::Writer& writer, int id) const {
+    PrintError(writer, id, "not found"sv);
+}
+
+void RequestHandler::PrintStopRequestResponce(json::Writer& writer, int id, std::string_view name) const {
+    auto buses_names = FindStopBuses(name);
+    if (!buses_names) {
+        PrintNotFound(writer, id);
+        return;
+    }
+
+    writer.StartDict().Key("buses"sv).StartArray();
+    for (const auto& bus_name : *buses_names) {
+        writer.Value(bus_name);
+    }
+    writer.EndArray()
+        .Key("request_id"sv).Value(id)
+    .EndDict();
+}
+
+void RequestHandler::PrintBusRequestResponce(json::Writer& writer, int id, std::string_view name) const {
+    auto stat = GetBusStat(name);
+    if (!stat) {
+        PrintNotFound(writer, id);
+        return;
+    }
+
+    writer.StartDict()
+        .Key("curvature"sv).Value(stat->curvature)
+        .Key("request_id"sv).Value(id)
+        .Key("route_length"sv).Value(stat->bus_length)
+        .Key("stop_count"sv).Value(stat->stop_count)
+        .Key("unique_stop_count"sv).Value(stat->unique_stop_count)
+    .EndDict();
+}
+
+void RequestHandler::PrintRouteRequestResponce(json::Writer& writer, int id, Route route) const {
+    if (!queries_->GetFeatures().places && (IsPlace(route.from) || IsPlace(route.to))) {
+        PrintError(writer, id, "not supported"sv);
+        return;
+    }
     if (route.from == route.to) {
-        return json::Builder{}
-            .StartDict()
-                .Key("items").Value(json::Array{})
-                .Key("request_id").Value(id)
-                .Key("total_time").Value(0)
-            .EndDict()
-        .Build();
-    }
-
-    if (auto built_route = router_.BuildRoute(route.from, route.to)) {
-        json::Array items;
-
-        for (auto item : built_route->items) {
-            if (std::holds_alternative<RouteInfo::WaitItem>(item)) {
-                auto wait_item = std::get<RouteInfo::WaitItem>(item);
-                items.push_back(
-                    json::Builder{}
-                        .StartDict()
-                            .Key("stop_name"s).Value(wait_item.stop.data())
-                            .Key("time"s).Value(wait_item.time.count())
-                            .Key("type"s).Value("Wait"s)
-                        .EndDict()
-                    .Build()
-                );
-            } else if (std::holds_alternative<RouteInfo::BusItem>(item)) {
-                auto bus_item = std::get<RouteInfo::BusItem>(item);
-                items.push_back(
-                    json::Builder{}
-                        .StartDict()
-                            .Key("bus"s).Value(bus_item.bus.data())
-                            .Key("span_count"s).Value(static_cast<int>(bus_item.span_count))
-                            .Key("time"s).Value(bus_item.time.count())
-                            .Key("type"s).Value("Bus"s)
-                        .EndDict()
-                    .Build()
-                );
-            }
-        }
+        writer.StartDict()
+            .Key("items"sv).StartArray().EndArray()
+            .Key("request_id"sv).Value(id)
+            .Key("total_time"sv).Value(0)
+        .EndDict();
+        return;
+    }
 
-        return json::Builder{}
-            .StartDict()
-                .Key("items").Value(items)
-                .Key("request_id").Value(id)
-                .Key("total_time").Value(built_route->total_time.count())
-            .EndDict()
-        .Build();
+    PrintBuiltRouteResponce(writer, id, queries_->BuildRoute(route.from, route.to));
+}
+
+void RequestHandler::PrintBuiltRouteResponce(json::Writer& writer,
+                                             int id,
+                                             const std::optional<RouteInfo>& built_route) const {
+    if (!built_route) {
+        PrintNotFound(writer, id);
+        return;
     }
 
-    return json::Builder{}
-        .StartDict()
-            .Key("request_id").Value(id)
-            .Key("error_message").Value("not found")
-        .EndDict()
-    .Build();
+    writer.StartDict().Key("items"sv).StartArray();
+    for (const auto& item : built_route->items) {
+        if (std::holds_alternative<RouteInfo::WaitItem>(item)) {
+            const auto& wait_item = std::get<RouteInfo::WaitItem>(item);
+            writer.StartDict()
+                .Key("stop_name"sv).Value(wait_item.stop)
+                .Key("time"sv).Value(wait_item.time.count())
+                .Key("type"sv).Value("Wait"sv)
+            .EndDict();
+        } else if (std::holds_alternative<RouteInfo::BusItem>(item)) {
+            const auto& bus_item = std::get<RouteInfo::BusItem>(item);
+            writer.StartDict()
+                .Key("bus"sv).Value(bus_item.bus)
+                .Key("span_count"sv).Value(static_cast<int>(bus_item.span_count))
+                .Key("time"sv).Value(bus_item.time.count())
+                .Key("type"sv).Value("Bus"sv)
+            .EndDict();
+        } else if (std::holds_alternative<RouteInfo::WalkItem>(item)) {
+            const auto& walk_item = std::get<RouteInfo::WalkItem>(item);
+            writer.StartDict();
+            if (!walk_item.from.empty()) {
+                writer.Key("from"sv).Value(walk_item.from);
+            }
+            writer.Key("time"sv).Value(walk_item.time.count());
+            if (!walk_item.to.empty()) {
+                writer.Key("to"sv).Value(walk_item.to);
+            }
+            writer.Key("type"sv).Value("Walk"sv)
+            .EndDict();
+        }
+    }
+    writer.EndArray()
+        .Key("request_id"sv).Value(id)
+        .Key("total_time"sv).Value(built_route->total_time.count())
+    .EndDict();
 }
 
-json::Node RequestHandler::GetMapRequestResponce(int id) const {
-    std::ostringstream stream;
-    renderer_.RenderAll(catalogue_, stream);
-    return json::Builder{}
-        .StartDict()
-            .Key("map"s).Value(stream.str())
-            .Key("request_id"s).Value(id)
-        .EndDict()
-    .Build();
+void RequestHandler::PrintMapRequestResponce(json::Writer& writer, int id) const {
+    writer.StartDict()
+        .Key("map"sv).Value(queries_->GetMap())
+        .Key("request_id"sv).Value(id)
+    .EndDict();
 }
 
-json::Node RequestHandler::GetRequestResponce(int id,
-                                  const std::string& type,
-                                  const std::string& name,
-                                  Route route) const {
-    json::Node responce;
+// A tile outside the map is not found
+void RequestHandler::PrintMapTileRequestResponce(json::Writer& writer, int id, const json::flat::Node& tile_node) const {
+    if (!queries_->GetFeatures().tiles) {
+        PrintError(writer, id, "not supported"sv);
+        return;
+    }
+    const auto tile = tile_node.IsDict() ? tile_node.AsDict() : json::flat::Dict{};
+    const auto is_int = [&tile](std::string_view key) {
+        return tile.count(key) && tile.at(key).IsInt();
+    };
+    const auto map = is_int("z"sv) && is_int("x"sv) && is_int("y"sv)
+        ? queries_->RenderTile(tile.at("z").AsInt(), tile.at("x").AsInt(), tile.at("y").AsInt())
+        : std::nullopt;
+    if (!map) {
+        PrintNotFound(writer, id);
+        return;
+    }
+
+    writer.StartDict()
+        .Key("map"sv).Value(std::string_view(*map))
+        .Key("request_id"sv).Value(id)
+    .EndDict();
+}
 
+void RequestHandler::PrintRequestResponce(json::Writer& writer,
+                                          int id,
+                                          std::string_view type,
+                                          std::string_view name,
+                                          Route route) const {
     if (type == "Stop") {
-        responce = GetStopRequestResponce(id, name);
+        PrintStopRequestResponce(writer, id, name);
     } else if (type == "Bus") {
-        responce = GetBusRequestResponce(id, name);
+        PrintBusRequestResponce(writer, id, name);
     } else if (type == "Map") {
-        responce = GetMapRequestResponce(id);
+        PrintMapRequestResponce(writer, id);
     } else if (type == "Route") {
-        responce = GetRouteRquestResponce(id, route);
+        PrintRouteRequestResponce(writer, id, route);
+    } else {
+        writer.Value(nullptr);
+    }
+}
+
+void RequestHandler::PrintRequest(json::Writer& writer,
+                                  const json::flat::Node& request,
+                                  const std::optional<RouteInfo>* batched_route) const {
+    auto id = request.AsDict().at("id").AsInt();
+    if (batched_route) {
+        PrintBuiltRouteResponce(writer, id, *batched_route);
+        return;
+    }
+    auto type = request.AsDict().at("type").AsString();
+    auto name = request.AsDict().count("name")
+        ? request.AsDict().at("name").AsString()
+        : "";
+    std::optional<RoutePoint> from;
+    std::optional<RoutePoint> to;
+    if (request.AsDict().count("from")) {
+        from = AsRoutePoint(request.AsDict().at("from"));
+        to = request.AsDict().count("to") ? AsRoutePoint(request.AsDict().at("to")) : std::nullopt;
+        if (type == "Route"sv && (!from || !to)) {
+            PrintNotFound(writer, id);
+            return;
+        }
+    }
+    Route route = from && to ? Route{*from, *to} : Route{};
+
+    // {"type": "Map", "tile": {"z": 2, "x": 1, "y": 3}} asks for one tile of the map
+    if (type == "Map"sv && request.AsDict().count("tile")) {
+        PrintMapTileRequestResponce(writer, id, request.AsDict().at("tile"));
+        return;
+    }
+    PrintRequestResponce(writer, id, type, name, route);
+}
+
+// Batched routes are built first, see BuildBatchedRoutes. Then each
+// response goes to the stream as soon as it is computed
+void RequestHandler::PrintRequestsResponce(json::flat::Array requests, std::ostream& os) const {
+    if (thread_count_ > 1 && requests.size() > 1) {
+        PrintRequestsResponceParallel(requests, os);
+        return;
+    }
+
+    const BatchedRoutes batched_routes = BuildBatchedRoutes(requests);
+    json::Writer writer(os);
+    writer.StartArray();
+    for (size_t index = 0; index < requests.size(); ++index) {
+        const auto it = batched_routes.find(index);
+        PrintRequest(writer, requests[index], it != batched_routes.end() ? &it->second : nullptr);
+    }
+    writer.EndArray();
+}
+
+// Requests that can't be batched, malformed ones included, are left to
+// PrintRequest, so errors surface in request order as before
+RequestHandler::BatchedRoutes RequestHandler::BuildBatchedRoutes(json::flat::Array requests) const {
+    BatchedRoutes batched_routes;
+    if (!queries_->GetFeatures().batched_routes) {
+        return batched_routes;
+    }
+
+    struct Target {
+        size_t request;
+        std::string_view stop;
+    };
+    std::unordered_map<std::string_view, std::vector<Target>> targets_by_source;
+    for (size_t index = 0; index < requests.size(); ++index) {
+        if (!requests[index].IsDict()) {
+            continue;
+        }
+        const auto request = requests[index].AsDict();
+        if (!request.count("id") || !request.count("type") || !request.count("from") || !request.count("to")) {
+            continue;
+        }
+        const auto& type = request.at("type");
+        const auto& from = request.at("from");
+        const auto& to = request.at("to");
+        if (!type.IsString() || type.AsString() != "Route"sv || !from.IsString() || !to.IsString()) {
+            continue;
+        }
+
+        if (from.AsString() != to.AsString()) {
+            targets_by_source[from.AsString()].push_back(Target{index, to.AsString()});
+        }
+    }
+
+    // A single request from a source gains nothing from a batch
+    std::vector<std::pair<std::string_view, std::vector<Target>>> batches;
+    for (auto& [source, targets] : targets_by_source) {
+        if (targets.size() > 1) {
+            batches.emplace_back(source, std::move(targets));
+        }
+    }
+
+    // A batch that fails is left to PrintRequest as well
+    std::vector<std::vector<std::optional<RouteInfo>>> routes(batches.size());
+    parallel::ForEachIndex(batches.size(), thread_count_, [&](size_t index) {
+        const auto& [source, targets] = batches[index];
+        std::vector<std::string_view> stops;
+        stops.reserve(targets.size());
+        for (const auto& target : targets) {
+            stops.push_back(target.stop);
+        }
+        try {
+            routes[index] = queries_->BuildRoutes(source, stops);
+        } catch (...) {
+            routes[index].clear();
+        }
+    });
+
+    for (size_t index = 0; index < batches.size(); ++index) {
+        for (size_t i = 0; i < routes[index].size(); ++i) {
+            batched_routes.emplace(batches[index].second[i].request, std::move(routes[index][i]));
+        }
     }
-    return responce;
+    return batched_routes;
 }
 
-json::Document RequestHandler::GetRequestsResponce(const json::Array& requests) const {
-    json::Array responses;
-    for (const auto& request : requests) {
-        auto id = request.AsDict().at("id").AsInt();
-        auto type = request.AsDict().at("type").AsString();
-        auto name = request.AsDict().count("name")
-            ? request.AsDict().at("name").AsString()
-            : "";
-        Route route = request.AsDict().count("from")
-            ? Route{request.AsDict().at("from").AsString(), request.AsDict().at("to").AsString()}
-            : Route{};
+// Workers print each response on its own, indented as an item of the output
+// array, and this thread writes them out in request order as soon as all the
+// earlier ones are done. Requests after a failed one are skipped, so the
+// output stops and the error is rethrown where the sequential loop would
+void RequestHandler::PrintRequestsResponceParallel(json::flat::Array requests, std::ostream& os) const {
+    struct Responce {
+        std::string text;
+        std::exception_ptr error;
+        bool is_done = false;
+        bool is_skipped = false;
+    };
+
+    std::vector<Responce> responces(requests.size());
+    std::mutex mutex;
+    std::condition_variable done;
+    std::atomic<size_t> first_failed = requests.size();
+    const BatchedRoutes batched_routes = BuildBatchedRoutes(requests);
+
+    std::thread workers([&] {
+        parallel::ForEachIndex(requests.size(), thread_count_, [&](size_t index) {
+            Responce responce;
+            if (index > first_failed.load(std::memory_order_relaxed)) {
+                responce.is_skipped = true;
+            } else {
+                try {
+                    std::ostringstream text;
+                    json::Writer writer(text, 1);
+                    const auto it = batched_routes.find(index);
+                    PrintRequest(writer, requests[index], it != batched_routes.end() ? &it->second : nullptr);
+                    responce.text = std::move(text).str();
+                } catch (...) {
+                    responce.error = std::current_exception();
+                    size_t failed = first_failed.load();
+                    while (index < failed && !first_failed.compare_exchange_weak(failed, index)) {
+                    }
+                }
+            }
+            responce.is_done = true;
+
+            {
+                std::lock_guard lock(mutex);
+                responces[index] = std::move(responce);
+            }
+            done.notify_one();
+        });
+    });
 
-        responses.emplace_back(GetRequestResponce(id, type, name, route));
+    json::Writer writer(os);
+    writer.StartArray();
+    for (size_t index = 0; index < responces.size(); ++index) {
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&responces, index] {
+            return responces[index].is_done;
+        });
+        if (responces[index].error || responces[index].is_skipped) {
+            break;
+        }
+        const std::string text = std::move(responces[index].text);
+        lock.unlock();
+        writer.RawValue(text);
     }
+    workers.join();
 
-    return json::Document(responses);
+    for (const auto& responce : responces) {
+        if (responce.error) {
+            std::rethrow_exception(responce.error);
+        }
+    }
+    writer.EndArray();
 }
 
-void RequestHandler::PrintRequestsResponce(const json::Array& requests, std::ostream& os) const {
-    json::Print(GetRequestsResponce(requests), os);
+void RequestHandler::SetThreadCount(size_t thread_count) {
+    thread_count_ = std::max<size_t>(thread_count, 1);
 }
 
 void RequestHandler::PrintMap(std::ostream& os) {
-    renderer_.RenderAll(catalogue_, os);
+    os << queries_->GetMap();
 }
\ No newline at end of file
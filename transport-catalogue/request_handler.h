@@ -1,11 +1,15 @@
 #pragma once
 
+#include "catalogue_queries.h"
 #include "transport_catalogue.h"
 #include "json.h"
-#include "json_builder.h"
+#include "json_flat.h"
 #include "map_renderer.h"
 #include "transport_router.h"
+#include "catalogue_view.h"
+#include <memory>
 #include <optional>
+#include <unordered_map>
 #include <iostream>
 
 class RequestHandler {
@@ -15,35 +19,55 @@ public:
         MapRenderer& renderer,
         const TransportRouter& router
     );
+    // Answers from a mapped snapshot instead of a built catalogue
+    explicit RequestHandler(const CatalogueView& view);
 
     std::optional<BusStat> GetBusStat(std::string_view route_name) const;
+    // Sorted names of buses through the stop, empty for an unknown stop
+    std::optional<std::vector<std::string_view>> FindStopBuses(std::string_view stop_name) const;
 
-    std::unordered_set<Bus*> GetBusesByStop(std::string_view stop_name) const;
-
-    json::Document GetRequestsResponce(const json::Array& requests) const;
-    void PrintRequestsResponce(const json::Array& requests, std::ostream& os) const;
+    void PrintRequestsResponce(json::flat::Array requests, std::ostream& os) const;
+    // With more than one thread responses are computed in parallel and
+    // printed in request order. 1 by default
+    void SetThreadCount(size_t thread_count);
 
     void PrintMap(std::ostream& os);
 
 private:
-    const TransportCatalogue& catalogue_;
-    MapRenderer& renderer_;
-    const TransportRouter& router_;
+    std::unique_ptr<const CatalogueQueries> queries_;
+    size_t thread_count_ = 1;
 
     struct Route {
-        const std::string_view from;
-        const std::string_view to;
+        const RoutePoint from;
+        const RoutePoint to;
     };
-    
-    json::Node GetRequestResponce(
+
+    // Routes of the batch requests with the index, see BuildBatchedRoutes
+    using BatchedRoutes = std::unordered_map<size_t, std::optional<RouteInfo>>;
+
+    // Route requests between stops that share the source stop get their
+    // routes from one BuildRoutes call. Empty without the batched_routes feature
+    BatchedRoutes BuildBatchedRoutes(json::flat::Array requests) const;
+
+    // batched_route is the route of a batched Route request, or nullptr
+    void PrintRequest(json::Writer& writer,
+                      const json::flat::Node& request,
+                      const std::optional<RouteInfo>* batched_route) const;
+    void PrintRequestsResponceParallel(json::flat::Array requests, std::ostream& os) const;
+    void PrintRequestResponce(
+        json::Writer& writer,
         int id,
-        const std::string& type,
-        const std::string& name,
+        std::string_view type,
+        std::string_view name,
         Route route
     ) const;
 
-    json::Node GetStopRequestResponce(int id, const std::string& name) const;
-    json::Node GetBusRequestResponce(int id, const std::string& name) const;
-    json::Node GetRouteRquestResponce(int id, Route route) const;
-    json::Node GetMapRequestResponce(int id) const;
+    void PrintError(json::Writer& writer, int id, std::string_view message) const;
+    void PrintNotFound(json::Writer& writer, int id) const;
+    void PrintStopRequestResponce(json::Writer& writer, int id, std::string_view name) const;
+    void PrintBusRequestResponce(json::Writer& writer, int id, std::string_view name) const;
+    void PrintRouteRequestResponce(json::Writer& writer, int id, Route route) const;
+    void PrintBuiltRouteResponce(json::Writer& writer, int id, const std::optional<RouteInfo>& built_route) const;
+    void PrintMapRequestResponce(json::Writer& writer, int id) const;
+    void PrintMapTileRequestResponce(json::Writer& writer, int id, const json::flat::Node& tile_node) const;
 };
\ No newline at end of file
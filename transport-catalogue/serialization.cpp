@@ -0,0 +1,283 @@
+#include "serialization.h"
+
+#include <array>
+#include <fstream>
+#include <unordered_map>
+
+using namespace std::literals;
+
+namespace serialization {
+
+namespace {
+
+constexpr std::array<char, 4> MAGIC = {'T', 'C', 'D', 'B'};
+constexpr uint32_t VERSION = 4;
+
+void SaveHeader(Writer& writer) {
+    writer.Write(MAGIC);
+    writer.Write(VERSION);
+}
+
+void LoadHeader(Reader& reader) {
+    if (reader.Read<std::array<char, 4>>() != MAGIC) {
+        throw FormatError("Not a transport catalogue snapshot"s);
+    }
+    if (const auto version = reader.Read<uint32_t>(); version != VERSION) {
+        throw FormatError("Unsupported snapshot version "s + std::to_string(version));
+    }
+}
+
+void SaveCatalogue(Writer& writer, const TransportCatalogue& catalogue) {
+    const auto stops = catalogue.GetStopsNames();
+    std::unordered_map<std::string_view, uint64_t> stop_index_by_name;
+
+    writer.WriteSize(stops.size());
+    for (size_t i = 0; i < stops.size(); ++i) {
+        const Stop* stop = catalogue.GetStop(stops[i]);
+        writer.WriteString(stop->name);
+        writer.Write(stop->coordinates.lat);
+        writer.Write(stop->coordinates.lng);
+        stop_index_by_name[stop->name] = i;
+    }
+
+    const auto distances = catalogue.GetStopsDistances();
+    writer.WriteSize(distances.size());
+    for (const auto& [from, to, distance] : distances) {
+        writer.Write(stop_index_by_name.at(from));
+        writer.Write(stop_index_by_name.at(to));
+        writer.Write(distance);
+    }
+
+    const auto buses = catalogue.GetBusesNames();
+    writer.WriteSize(buses.size());
+    for (const auto& bus_name : buses) {
+        const Bus* bus = catalogue.GetBus(bus_name);
+        writer.WriteString(bus->name);
+        writer.Write(bus->is_roundtrip);
+        writer.WriteSize(bus->stops.size());
+        for (const StopId stop : bus->stops) {
+            writer.Write(uint64_t{stop});
+        }
+    }
+}
+
+void LoadCatalogue(Reader& reader, TransportCatalogue& catalogue) {
+    // A stop takes a name size and two coordinates at least
+    std::vector<std::string_view> stops(reader.ReadCount(sizeof(uint64_t) + 2 * sizeof(double)));
+    for (auto& stop_name : stops) {
+        const auto name = reader.ReadString();
+        const auto lat = reader.Read<double>();
+        const auto lng = reader.Read<double>();
+        catalogue.AddStop(name, geo::Coordinates{lat, lng});
+        stop_name = catalogue.GetStop(name)->name;
+    }
+
+    auto stop_by_index = [&stops](uint64_t index) {
+        if (index >= stops.size()) {
+            throw FormatError("Stop index is out of range"s);
+        }
+        return stops[index];
+    };
+
+    for (size_t count = reader.ReadSize(); count > 0; --count) {
+        const auto from = stop_by_index(reader.Read<uint64_t>());
+        const auto to = stop_by_index(reader.Read<uint64_t>());
+        catalogue.SetStopsDistance(from, to, reader.Read<double>());
+    }
+
+    for (size_t count = reader.ReadSize(); count > 0; --count) {
+        const auto name = reader.ReadString();
+        const auto is_roundtrip = reader.Read<bool>();
+        std::vector<std::string_view> bus_stops(reader.ReadCount(sizeof(uint64_t)));
+        for (auto& stop_name : bus_stops) {
+            stop_name = stop_by_index(reader.Read<uint64_t>());
+        }
+        catalogue.AddBus(name, bus_stops, is_roundtrip);
+    }
+    catalogue.Finalize();
+}
+
+void SaveColor(Writer& writer, const svg::Color& color) {
+    writer.Write(static_cast<uint8_t>(color.index()));
+    if (std::holds_alternative<std::string>(color)) {
+        writer.WriteString(std::get<std::string>(color));
+    } else if (std::holds_alternative<svg::Rgb>(color)) {
+        const auto& rgb = std::get<svg::Rgb>(color);
+        writer.Write(rgb.red);
+        writer.Write(rgb.green);
+        writer.Write(rgb.blue);
+    } else if (std::holds_alternative<svg::Rgba>(color)) {
+        const auto& rgba = std::get<svg::Rgba>(color);
+        writer.Write(rgba.red);
+        writer.Write(rgba.green);
+        writer.Write(rgba.blue);
+        writer.Write(rgba.opacity);
+    }
+}
+
+svg::Color LoadColor(Reader& reader) {
+    switch (reader.Read<uint8_t>()) {
+        case 0:
+            return std::monostate{};
+        case 1:
+            return reader.ReadString();
+        case 2: {
+            const auto red = reader.Read<uint8_t>();
+            const auto green = reader.Read<uint8_t>();
+            const auto blue = reader.Read<uint8_t>();
+            return svg::Rgb(red, green, blue);
+        }
+        case 3: {
+            const auto red = reader.Read<uint8_t>();
+            const auto green = reader.Read<uint8_t>();
+            const auto blue = reader.Read<uint8_t>();
+            const auto opacity = reader.Read<double>();
+            return svg::Rgba(red, green, blue, opacity);
+        }
+        default:
+            throw FormatError("Unknown color type"s);
+    }
+}
+
+void SaveRenderSettings(Writer& writer, const RenderSettings& settings) {
+    writer.Write(settings.width_);
+    writer.Write(settings.height_);
+    writer.Write(settings.padding_);
+    writer.Write(settings.line_width_);
+    writer.Write(settings.stop_radius_);
+    writer.Write(settings.bus_label_font_size_);
+    writer.Write(settings.bus_label_offset_);
+    writer.Write(settings.stop_label_font_size_);
+    writer.Write(settings.stop_label_offset_);
+    SaveColor(writer, settings.underlayer_color_);
+    writer.Write(settings.underlayer_width_);
+    writer.WriteSize(settings.color_palette_.size());
+    for (const auto& color : settings.color_palette_) {
+        SaveColor(writer, color);
+    }
+}
+
+RenderSettings LoadRenderSettings(Reader& reader) {
+    RenderSettings settings;
+    settings.width_ = reader.Read<double>();
+    settings.height_ = reader.Read<double>();
+    settings.padding_ = reader.Read<double>();
+    settings.line_width_ = reader.Read<double>();
+    settings.stop_radius_ = reader.Read<double>();
+    settings.bus_label_font_size_ = reader.Read<int>();
+    settings.bus_label_offset_ = reader.Read<svg::Point>();
+    settings.stop_label_font_size_ = reader.Read<int>();
+    settings.stop_label_offset_ = reader.Read<svg::Point>();
+    settings.underlayer_color_ = LoadColor(reader);
+    settings.underlayer_width_ = reader.Read<double>();
+    settings.color_palette_.resize(reader.ReadCount(sizeof(uint8_t)));
+    for (auto& color : settings.color_palette_) {
+        color = LoadColor(reader);
+    }
+    return settings;
+}
+
+}  // namespace
+
+Writer::Writer(std::ostream& out)
+    : out_(out) {
+}
+
+void Writer::WriteSize(size_t size) {
+    Write(static_cast<uint64_t>(size));
+}
+
+void Writer::WriteString(std::string_view str) {
+    WriteSize(str.size());
+    out_.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+Reader::Reader(std::istream& in)
+    : in_(in) {
+    const auto position = in_.tellg();
+    if (position == std::streampos(-1) || !in_.seekg(0, std::ios::end)) {
+        in_.clear();
+        return;
+    }
+    const auto end = in_.tellg();
+    in_.seekg(position);
+    if (end != std::streampos(-1) && end >= position) {
+        remaining_ = static_cast<size_t>(end - position);
+    }
+}
+
+size_t Reader::ReadSize() {
+    return static_cast<size_t>(Read<uint64_t>());
+}
+
+size_t Reader::ReadCount(size_t item_size) {
+    const size_t count = ReadSize();
+    if (item_size > 0 && count > remaining_ / item_size) {
+        throw FormatError("Size is larger than the rest of the snapshot"s);
+    }
+    return count;
+}
+
+std::string Reader::ReadString() {
+    std::string str(ReadCount(1), '\0');
+    ReadBytes(str.data(), str.size());
+    return str;
+}
+
+size_t Reader::GetRemainingSize() const {
+    return remaining_;
+}
+
+void Reader::ReadBytes(char* data, size_t size) {
+    if (size > remaining_ || !in_.read(data, static_cast<std::streamsize>(size))) {
+        throw FormatError("Unexpected end of snapshot"s);
+    }
+    if (remaining_ != std::numeric_limits<size_t>::max()) {
+        remaining_ -= size;
+    }
+}
+
+SerializationSettings AsSerializationSettings(const json::Dict& settings) {
+    SerializationSettings result{settings.at("file"s).AsString(), std::nullopt};
+    if (settings.count("mapped_file"s) > 0) {
+        result.mapped_file = settings.at("mapped_file"s).AsString();
+    }
+    return result;
+}
+
+void SaveBase(const std::filesystem::path& file,
+              const TransportCatalogue& catalogue,
+              const RenderSettings& render_settings,
+              const TransportRouter& router) {
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Can't open "s + file.string() + " for writing"s);
+    }
+
+    Writer writer(out);
+    SaveHeader(writer);
+    SaveCatalogue(writer, catalogue);
+    SaveRenderSettings(writer, render_settings);
+    router.Serialize(writer);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write "s + file.string());
+    }
+}
+
+std::unique_ptr<TransportRouter> LoadBase(const std::filesystem::path& file,
+                                          TransportCatalogue& catalogue,
+                                          RenderSettings& render_settings) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Can't open "s + file.string() + " for reading"s);
+    }
+
+    Reader reader(in);
+    LoadHeader(reader);
+    LoadCatalogue(reader, catalogue);
+    render_settings = LoadRenderSettings(reader);
+    return std::make_unique<TransportRouter>(catalogue, reader);
+}
+
+}  // namespace serialization
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "transport_catalogue.h"
+#include "map_renderer.h"
+#include "transport_router.h"
+
+namespace serialization {
+
+class FormatError : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+// Snapshots are written in the host byte order, sizes as 64-bit integers
+class Writer {
+public:
+    explicit Writer(std::ostream& out);
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void WriteVector(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteSize(values.size());
+        out_.write(reinterpret_cast<const char*>(values.data()),
+                   static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+
+    void WriteSize(size_t size);
+    void WriteString(std::string_view str);
+
+private:
+    std::ostream& out_;
+};
+
+// Sizes are checked against the rest of the stream before anything is
+// allocated, so a truncated or corrupt snapshot throws FormatError. The rest
+// is unknown, and not checked, for a stream that can't seek
+class Reader {
+public:
+    explicit Reader(std::istream& in);
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if constexpr (std::is_same_v<T, bool>) {
+            // Any other byte would make an invalid bool
+            const auto value = Read<uint8_t>();
+            if (value > 1) {
+                throw FormatError("Invalid flag in snapshot");
+            }
+            return value == 1;
+        } else {
+            T value;
+            ReadBytes(reinterpret_cast<char*>(&value), sizeof(T));
+            return value;
+        }
+    }
+
+    template <typename T>
+    std::vector<T> ReadVector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        std::vector<T> values(ReadCount(sizeof(T)));
+        ReadBytes(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+        return values;
+    }
+
+    size_t ReadSize();
+    // Size of a sequence whose items take at least item_size bytes each
+    size_t ReadCount(size_t item_size);
+    std::string ReadString();
+
+    size_t GetRemainingSize() const;
+
+private:
+    void ReadBytes(char* data, size_t size);
+
+    std::istream& in_;
+    size_t remaining_ = std::numeric_limits<size_t>::max();
+};
+
+struct SerializationSettings {
+    std::filesystem::path file;
+    // Optional snapshot for CatalogueView, answered without loading the base
+    std::optional<std::filesystem::path> mapped_file;
+};
+
+SerializationSettings AsSerializationSettings(const json::Dict& settings);
+
+// Writes everything process_requests needs: catalogue, render settings,
+// routing graph and router tables
+void SaveBase(const std::filesystem::path& file,
+              const TransportCatalogue& catalogue,
+              const RenderSettings& render_settings,
+              const TransportRouter& router);
+
+// Fills an empty catalogue and render settings from a snapshot and returns
+// the router restored on top of that catalogue, without recomputing routes
+std::unique_ptr<TransportRouter> LoadBase(const std::filesystem::path& file,
+                                          TransportCatalogue& catalogue,
+                                          RenderSettings& render_settings);
+
+}  // namespace serialization
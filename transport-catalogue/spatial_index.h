@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace spatial {
+
+struct Box {
+    double min_x = 0;
+    double min_y = 0;
+    double max_x = 0;
+    double max_y = 0;
+
+    static Box Around(double x, double y) {
+        return {x, y, x, y};
+    }
+
+    bool Intersects(const Box& other) const {
+        return min_x <= other.max_x && other.min_x <= max_x
+            && min_y <= other.max_y && other.min_y <= max_y;
+    }
+
+    Box Expanded(double margin) const {
+        return {min_x - margin, min_y - margin, max_x + margin, max_y + margin};
+    }
+
+    void Extend(const Box& other) {
+        min_x = std::min(min_x, other.min_x);
+        min_y = std::min(min_y, other.min_y);
+        max_x = std::max(max_x, other.max_x);
+        max_y = std::max(max_y, other.max_y);
+    }
+};
+
+// Uniform grid over the boxes of items. Each cell lists the items whose box
+// overlaps it, so a query looks only at the cells it covers. Boxes outside
+// the grid bounds go to the border cells.
+template <typename Item>
+class GridIndex {
+public:
+    GridIndex() = default;
+
+    // The grid gets about ITEMS_PER_CELL items per cell for items_count items
+    GridIndex(const Box& bounds, size_t items_count)
+        : bounds_(bounds) {
+        const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(items_count) / ITEMS_PER_CELL)));
+        side_ = std::clamp<size_t>(side, 1, MAX_SIDE);
+        cell_width_ = (bounds.max_x - bounds.min_x) / static_cast<double>(side_);
+        cell_height_ = (bounds.max_y - bounds.min_y) / static_cast<double>(side_);
+        cells_.resize(side_ * side_);
+    }
+
+    void Insert(const Box& box, Item item) {
+        const auto index = static_cast<uint32_t>(items_.size());
+        items_.push_back(Entry{box, std::move(item)});
+        ForEachCell(box, [this, index](size_t cell) {
+            cells_[cell].push_back(index);
+        });
+    }
+
+    size_t GetItemsCount() const {
+        return items_.size();
+    }
+
+    // Calls callback(item) for every item whose box intersects box, once
+    // per item and in insertion order
+    template <typename Callback>
+    void ForEachIntersecting(const Box& box, Callback callback) const {
+        std::vector<uint32_t> candidates;
+        ForEachCell(box, [this, &candidates](size_t cell) {
+            candidates.insert(candidates.end(), cells_[cell].begin(), cells_[cell].end());
+        });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        for (const uint32_t index : candidates) {
+            if (items_[index].box.Intersects(box)) {
+                callback(items_[index].item);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t ITEMS_PER_CELL = 4;
+    static constexpr size_t MAX_SIDE = 1024;
+
+    struct Entry {
+        Box box;
+        Item item;
+    };
+
+    size_t ToColumn(double x) const {
+        return ToCell(x - bounds_.min_x, cell_width_);
+    }
+
+    size_t ToRow(double y) const {
+        return ToCell(y - bounds_.min_y, cell_height_);
+    }
+
+    size_t ToCell(double offset, double cell_size) const {
+        if (!(cell_size > 0) || !(offset > 0)) {
+            return 0;
+        }
+        return std::min(static_cast<size_t>(offset / cell_size), side_ - 1);
+    }
+
+    template <typename Function>
+    void ForEachCell(const Box& box, Function function) const {
+        const size_t last_column = ToColumn(box.max_x);
+        const size_t last_row = ToRow(box.max_y);
+        for (size_t row = ToRow(box.min_y); row <= last_row; ++row) {
+            for (size_t column = ToColumn(box.min_x); column <= last_column; ++column) {
+                function(row * side_ + column);
+            }
+        }
+    }
+
+    Box bounds_;
+    size_t side_ = 1;
+    double cell_width_ = 0;
+    double cell_height_ = 0;
+
+    std::vector<Entry> items_;
+    std::vector<std::vector<uint32_t>> cells_ = std::vector<std::vector<uint32_t>>(1);
+};
+
+// Sparse grid of square cells over points, which grows as points are added
+// and needs no bounds in advance. Only the cells holding points are stored.
+template <typename Item>
+class HashGrid {
+public:
+    explicit HashGrid(double cell_size)
+        : cell_size_(cell_size) {
+    }
+
+    void Insert(double x, double y, Item item) {
+        if (items_count_ == 0) {
+            bounds_ = Box::Around(x, y);
+        } else {
+            bounds_.Extend(Box::Around(x, y));
+        }
+        cells_[ToKey(ToCell(x), ToCell(y))].push_back(Entry{x, y, std::move(item)});
+        ++items_count_;
+    }
+
+    size_t GetItemsCount() const {
+        return items_count_;
+    }
+
+    // Box of all the points, zero box for an empty grid
+    const Box& GetBounds() const {
+        return bounds_;
+    }
+
+    // Calls callback(item) for every point inside box, in unspecified order
+    template <typename Callback>
+    void ForEachInBox(const Box& box, Callback callback) const {
+        if (items_count_ == 0 || !box.Intersects(bounds_)) {
+            return;
+        }
+        const auto for_each_in_cell = [&box, &callback](const std::vector<Entry>& cell) {
+            for (const auto& entry : cell) {
+                if (entry.x >= box.min_x && entry.x <= box.max_x && entry.y >= box.min_y && entry.y <= box.max_y) {
+                    callback(entry.item);
+                }
+            }
+        };
+
+        // A box wider than the data is cut to the bounds, and when it still
+        // covers more cells than are stored, the stored cells are scanned
+        const int64_t first_column = ToCell(std::max(box.min_x, bounds_.min_x));
+        const int64_t last_column = ToCell(std::min(box.max_x, bounds_.max_x));
+        const int64_t first_row = ToCell(std::max(box.min_y, bounds_.min_y));
+        const int64_t last_row = ToCell(std::min(box.max_y, bounds_.max_y));
+        const double cells_count = static_cast<double>(last_column - first_column + 1) * static_cast<double>(last_row - first_row + 1);
+        if (cells_count > static_cast<double>(cells_.size())) {
+            for (const auto& [key, cell] : cells_) {
+                for_each_in_cell(cell);
+            }
+            return;
+        }
+
+        for (int64_t column = first_column; column <= last_column; ++column) {
+            for (int64_t row = first_row; row <= last_row; ++row) {
+                if (const auto it = cells_.find(ToKey(column, row)); it != cells_.end()) {
+                    for_each_in_cell(it->second);
+                }
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        double x;
+        double y;
+        Item item;
+    };
+
+    int64_t ToCell(double value) const {
+        return static_cast<int64_t>(std::floor(value / cell_size_));
+    }
+
+    static uint64_t ToKey(int64_t column, int64_t row) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(column)) << 32 | static_cast<uint32_t>(row);
+    }
+
+    double cell_size_;
+    Box bounds_;
+    size_t items_count_ = 0;
+    std::unordered_map<uint64_t, std::vector<Entry>> cells_;
+};
+
+}  // namespace spatial
@@ -17,19 +17,16 @@ void PrintBus(const Bus* bus, const TransportCatalogue& tc, std::ostream& os) {
     size_t stops_count = bus->stops.size();
     os << stops_count << " stops on bus, ";
     
-    std::unordered_set<std::string_view> unique_stops;
-    for (const auto& stop : bus->stops) {
-        unique_stops.emplace(stop->name);
-    }
+    std::unordered_set<StopId> unique_stops(bus->stops.begin(), bus->stops.end());
     os << unique_stops.size() << " unique stops, ";
     
     double fact_bus_length = 0, geo_bus_length = 0;
     for (size_t i = 0; i < bus->stops.size() - 1; ++i) {
-        auto current_stop = bus->stops[i];
-        auto next_stop = bus->stops[i + 1];
+        auto current_stop = tc.GetStop(bus->stops[i]);
+        auto next_stop = tc.GetStop(bus->stops[i + 1]);
         
         fact_bus_length += geo::ComputeDistance(current_stop->coordinates, next_stop->coordinates);
-        geo_bus_length += tc.GetStopsDistance(current_stop->name, next_stop->name);
+        geo_bus_length += tc.GetStopsDistance(current_stop->id, next_stop->id);
     }
     os << geo_bus_length << " bus length, ";
     os << geo_bus_length / fact_bus_length << " curvature";
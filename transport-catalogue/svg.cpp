@@ -1,9 +1,146 @@
 #include "svg.h"
 
+#include <charconv>
+#include <iterator>
+#include <span>
+
 namespace svg {
 
 using namespace std::literals;
 
+namespace {
+
+std::string_view ToString(StrokeLineCap cap) {
+    switch (cap) {
+        case StrokeLineCap::BUTT:
+            return "butt"sv;
+        case StrokeLineCap::ROUND:
+            return "round"sv;
+        case StrokeLineCap::SQUARE:
+            return "square"sv;
+    }
+    return {};
+}
+
+std::string_view ToString(StrokeLineJoin join) {
+    switch (join) {
+        case StrokeLineJoin::ARCS:
+            return "arcs"sv;
+        case StrokeLineJoin::ROUND:
+            return "round"sv;
+        case StrokeLineJoin::BEVEL:
+            return "bevel"sv;
+        case StrokeLineJoin::MITER:
+            return "miter"sv;
+        case StrokeLineJoin::MITER_CLIP:
+            return "miter-clip"sv;
+    }
+    return {};
+}
+
+// Tag printers shared by the shape objects and CompactDocument. Out is
+// std::ostream or OutputBuffer, which print the same text
+
+template <typename Out>
+void RenderStyle(Out& out, const PathStyle& style) {
+    if (style.fill_color) {
+        out << " fill=\""sv << *style.fill_color << "\""sv;
+    }
+    if (style.stroke_color) {
+        out << " stroke=\""sv << *style.stroke_color << "\""sv;
+    }
+    if (style.stroke_width) {
+        out << " stroke-width=\""sv << *style.stroke_width << "\""sv;
+    }
+    if (style.stroke_line_cap) {
+        out << " stroke-linecap=\""sv << *style.stroke_line_cap << "\""sv;
+    }
+    if (style.stroke_line_join) {
+        out << " stroke-linejoin=\""sv << *style.stroke_line_join << "\""sv;
+    }
+}
+
+// Writes the runs between special chars in one call
+template <typename Out>
+void RenderEscaped(Out& out, std::string_view text) {
+    size_t run_begin = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        std::string_view entity;
+        switch (text[i]) {
+            case '"':
+                entity = "&quot;"sv;
+                break;
+            case '\'':
+                entity = "&apos;"sv;
+                break;
+            case '<':
+                entity = "&lt;"sv;
+                break;
+            case '>':
+                entity = "&gt;"sv;
+                break;
+            case '&':
+                entity = "&amp;"sv;
+                break;
+            default:
+                continue;
+        }
+        out << text.substr(run_begin, i - run_begin) << entity;
+        run_begin = i + 1;
+    }
+    out << text.substr(run_begin);
+}
+
+template <typename Out>
+void RenderCircle(Out& out, Point center, double radius, const PathStyle& style) {
+    out << "<circle cx=\""sv << center.x << "\" cy=\""sv << center.y << "\" "sv;
+    out << "r=\""sv << radius << "\" "sv;
+    RenderStyle(out, style);
+    out << "/>"sv;
+}
+
+template <typename Out>
+void RenderPolyline(Out& out, std::span<const Point> points, const PathStyle& style) {
+    out << "<polyline points=\""sv;
+    bool is_first = true;
+    for (auto& point : points) {
+        if (!is_first) {
+            out << " "sv;
+        }
+        out << point.x << ","sv << point.y;
+        is_first = false;
+    }
+    out << "\""sv;
+
+    RenderStyle(out, style);
+
+    out << " />"sv;
+}
+
+template <typename Out>
+void RenderText(Out& out,
+                Point pos,
+                Point offset,
+                uint32_t font_size,
+                std::string_view font_family,
+                std::string_view font_weight,
+                std::string_view data,
+                const PathStyle& style) {
+    out << "<text x=\""sv << pos.x << "\" y=\""sv << pos.y << "\" "sv;
+    out << "dx=\""sv << offset.x << "\" dy=\""sv << offset.y << "\" "sv;
+    out << "font-size=\""sv << font_size << "\" "sv;
+    if (!font_family.empty())
+        out << "font-family=\""sv << font_family << "\" "sv;
+    if (!font_weight.empty())
+        out << "font-weight=\""sv << font_weight << "\""sv;
+    RenderStyle(out, style);
+    out << ">"sv;
+    RenderEscaped(out, data);
+    out << "</text>"sv;
+}
+
+}  // namespace
+
 void ColorPrinter::operator()(std::monostate) const {
     out << "none";
 }
@@ -30,45 +167,106 @@ std::ostream& operator<<(std::ostream& out, const Color& color) {
 }
 
 std::ostream& operator<<(std::ostream& out, const StrokeLineCap& cap) {
-    switch (cap) {
-        case StrokeLineCap::BUTT:
-            out << "butt"sv;
-            break;
-        case StrokeLineCap::ROUND:
-            out << "round"sv;
-            break;
-        case StrokeLineCap::SQUARE:
-            out << "square"sv;
-            break;
-    }
-    return out;
+    return out << ToString(cap);
 }
 
 std::ostream& operator<<(std::ostream& out, const StrokeLineJoin& join) {
-    switch (join) {
-        case StrokeLineJoin::ARCS:
-            out << "arcs"sv;
-            break;
-        case StrokeLineJoin::ROUND:
-            out << "round"sv;
-            break;
-        case StrokeLineJoin::BEVEL:
-            out << "bevel"sv;
-            break;
-        case StrokeLineJoin::MITER:
-            out << "miter"sv;
-            break;
-        case StrokeLineJoin::MITER_CLIP:
-            out << "miter-clip"sv;
-            break;
+    return out << ToString(join);
+}
+
+void RenderPathStyle(std::ostream& out, const PathStyle& style) {
+    RenderStyle(out, style);
+}
+
+// ---------- OutputBuffer ------------
+
+OutputBuffer& OutputBuffer::operator<<(std::string_view str) {
+    text_.append(str);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const char* str) {
+    return *this << std::string_view(str);
+}
+
+OutputBuffer& OutputBuffer::operator<<(char c) {
+    text_.push_back(c);
+    return *this;
+}
+
+// Same as std::ostream with the default precision, that is printf("%g")
+OutputBuffer& OutputBuffer::operator<<(double value) {
+    char chars[32];
+    const auto result = std::to_chars(std::begin(chars), std::end(chars), value, std::chars_format::general, 6);
+    text_.append(chars, result.ptr);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(int value) {
+    char chars[16];
+    const auto result = std::to_chars(std::begin(chars), std::end(chars), value);
+    text_.append(chars, result.ptr);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(uint32_t value) {
+    char chars[16];
+    const auto result = std::to_chars(std::begin(chars), std::end(chars), value);
+    text_.append(chars, result.ptr);
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const Color& color) {
+    if (std::holds_alternative<std::monostate>(color)) {
+        *this << "none"sv;
+    } else if (std::holds_alternative<std::string>(color)) {
+        *this << std::string_view(std::get<std::string>(color));
+    } else if (std::holds_alternative<Rgb>(color)) {
+        const auto& rgb = std::get<Rgb>(color);
+        *this << "rgb("sv
+            << static_cast<int>(rgb.red) << ","sv
+            << static_cast<int>(rgb.green) << ","sv
+            << static_cast<int>(rgb.blue) << ")"sv;
+    } else if (std::holds_alternative<Rgba>(color)) {
+        const auto& rgba = std::get<Rgba>(color);
+        *this << "rgba("sv
+            << static_cast<int>(rgba.red) << ","sv
+            << static_cast<int>(rgba.green) << ","sv
+            << static_cast<int>(rgba.blue) << ","sv
+            << rgba.opacity << ")"sv;
     }
-    return out;
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(StrokeLineCap cap) {
+    return *this << ToString(cap);
+}
+
+OutputBuffer& OutputBuffer::operator<<(StrokeLineJoin join) {
+    return *this << ToString(join);
+}
+
+std::string_view OutputBuffer::GetText() const {
+    return text_;
+}
+
+std::string OutputBuffer::Extract() {
+    return std::move(text_);
+}
+
+void OutputBuffer::Flush(std::ostream& out) {
+    out.write(text_.data(), static_cast<std::streamsize>(text_.size()));
+    text_.clear();
 }
 
 void ObjectContainer::AddPtr(std::unique_ptr<Object>&& object) {
     objects_.push_back(std::move(object));
 }
 
+void Document::Clear() {
+    objects_.clear();
+}
+
 void Object::Render(const RenderContext& context) const {
     context.RenderIndent();
 
@@ -91,11 +289,7 @@ Circle& Circle::SetRadius(double radius)  {
 }
 
 void Circle::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
-    out << "r=\""sv << radius_ << "\" "sv;
-    RenderAttrs(out);
-    out << "/>"sv;
+    RenderCircle(context.out, center_, radius_, style_);
 }
 
 // ---------- Polyline ----------------
@@ -106,53 +300,14 @@ Polyline& Polyline::AddPoint(Point point)  {
 }
 
 void Polyline::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    out << "<polyline points=\""sv;
-    bool is_first = true;
-    for (auto& point : points_) {
-        if (!is_first) {
-            out << " ";
-        }
-        out << point.x << ","sv << point.y;
-        is_first = false;
-    }
-    out << "\"";
-
-    RenderAttrs(out);
-
-    out << " />"sv;
+    RenderPolyline(context.out, points_, style_);
 }
 
 // ---------- Text --------------------
 
-std::string escapeForSVG(const std::string& input) {
-    std::string output;
-    for (const char& c : input) {
-        switch (c) {
-            case '"':
-                output += "&quot;";
-                break;
-            case '\'':
-                output += "&apos;";
-                break;
-            case '<':
-                output += "&lt;";
-                break;
-            case '>':
-                output += "&gt;";
-                break;
-            case '&':
-                output += "&amp;";
-                break;
-            default:
-                output += c;
-        }
-    }
-    return output;
-}
-
+// Escaped when the text is rendered
 Text& Text::SetData(std::string text)  {
-    data_ = std::move(escapeForSVG(text));
+    data_ = std::move(text);
     return *this;
 }
 
@@ -182,17 +337,7 @@ Text& Text::SetFontWeight(std::string font_weight) {
 }
 
 void Text::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    
-    out << "<text x=\""sv << pos_.x << "\" y=\""sv << pos_.y << "\" ";
-    out << "dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << "\" ";
-    out << "font-size=\""sv << font_size_ << "\" ";
-    if (!font_family_.empty())
-        out << "font-family=\""sv << font_family_ << "\" ";
-    if (!font_weight_.empty())
-        out << "font-weight=\""sv << font_weight_ << "\"";
-    RenderAttrs(out);
-    out << ">" << data_ << "</text>"sv;
+    RenderText(context.out, pos_, offset_, font_size_, font_family_, font_weight_, data_, style_);
 }
 
 // ---------- Document ----------------
@@ -213,4 +358,103 @@ void Document::Render(std::ostream& out) const {
     out << "</svg>"sv;
 }
 
+// ---------- CompactDocument ---------
+
+void CompactDocument::Add(const Circle& circle) {
+    objects_.push_back(ObjectRef{Kind::CIRCLE, static_cast<uint32_t>(circles_.size())});
+    circles_.push_back(CircleRecord{circle.center_, circle.radius_, InternStyle(circle.style_)});
+}
+
+void CompactDocument::Add(const Polyline& polyline) {
+    objects_.push_back(ObjectRef{Kind::POLYLINE, static_cast<uint32_t>(polylines_.size())});
+    polylines_.push_back(PolylineRecord{
+        static_cast<uint32_t>(points_.size()),
+        static_cast<uint32_t>(polyline.points_.size()),
+        InternStyle(polyline.style_)
+    });
+    points_.insert(points_.end(), polyline.points_.begin(), polyline.points_.end());
+}
+
+void CompactDocument::Add(const Text& text) {
+    objects_.push_back(ObjectRef{Kind::TEXT, static_cast<uint32_t>(texts_.size())});
+    texts_.push_back(TextRecord{
+        text.pos_,
+        text.offset_,
+        text.font_size_,
+        InternString(text.font_family_),
+        InternString(text.font_weight_),
+        InternString(text.data_),
+        InternStyle(text.style_)
+    });
+}
+
+void CompactDocument::Clear() {
+    objects_.clear();
+    circles_.clear();
+    polylines_.clear();
+    points_.clear();
+    texts_.clear();
+    strings_.clear();
+    string_ids_.clear();
+    styles_.clear();
+}
+
+void CompactDocument::Render(std::ostream& out) const {
+    OutputBuffer buffer;
+    Render(buffer);
+    buffer.Flush(out);
+}
+
+void CompactDocument::Render(OutputBuffer& out) const {
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    // Document indents each object twice, by itself and by Object::Render
+    for (const auto& object : objects_) {
+        out << "  "sv;
+        switch (object.kind) {
+            case Kind::CIRCLE: {
+                const auto& circle = circles_[object.index];
+                RenderCircle(out, circle.center, circle.radius, styles_[circle.style]);
+                break;
+            }
+            case Kind::POLYLINE: {
+                const auto& polyline = polylines_[object.index];
+                const std::span<const Point> points(points_.data() + polyline.first_point, polyline.points_count);
+                RenderPolyline(out, points, styles_[polyline.style]);
+                break;
+            }
+            case Kind::TEXT: {
+                const auto& text = texts_[object.index];
+                RenderText(out, text.pos, text.offset, text.font_size,
+                           strings_[text.font_family], strings_[text.font_weight], strings_[text.data],
+                           styles_[text.style]);
+                break;
+            }
+        }
+        out << '\n';
+    }
+    out << "</svg>"sv;
+}
+
+CompactDocument::StringId CompactDocument::InternString(std::string_view str) {
+    if (const auto it = string_ids_.find(str); it != string_ids_.end()) {
+        return it->second;
+    }
+    const auto id = static_cast<StringId>(strings_.size());
+    string_ids_.emplace(strings_.emplace_back(str), id);
+    return id;
+}
+
+// A map uses a few styles per palette color, so a linear search from the
+// latest style is enough
+CompactDocument::StyleId CompactDocument::InternStyle(const PathStyle& style) {
+    for (size_t i = styles_.size(); i > 0; --i) {
+        if (styles_[i - 1] == style) {
+            return static_cast<StyleId>(i - 1);
+        }
+    }
+    styles_.push_back(style);
+    return static_cast<StyleId>(styles_.size() - 1);
+}
+
 }  // namespace svg
\ No newline at end of file
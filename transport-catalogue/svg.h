@@ -1,9 +1,12 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 #include <optional>
@@ -16,6 +19,8 @@ struct Rgb {
         : red(r), green(g), blue(b) {
     }
 
+    bool operator==(const Rgb&) const = default;
+
     uint8_t red = 0, green = 0, blue = 0;
 };
 struct Rgba {
@@ -24,6 +29,8 @@ struct Rgba {
         : red(r), green(g), blue(b), opacity(a) {
     }
 
+    bool operator==(const Rgba&) const = default;
+
     uint8_t red = 0, green = 0, blue = 0;
     double opacity = 1;
 };
@@ -78,6 +85,45 @@ struct Offset {
     double dy = 0;
 };
 
+// Attributes shared by all the shapes, printed in this order
+struct PathStyle {
+    std::optional<Color> fill_color;
+    std::optional<Color> stroke_color;
+    std::optional<double> stroke_width;
+    std::optional<StrokeLineCap> stroke_line_cap;
+    std::optional<StrokeLineJoin> stroke_line_join;
+
+    bool operator==(const PathStyle&) const = default;
+};
+
+void RenderPathStyle(std::ostream& out, const PathStyle& style);
+
+// Growable text buffer with the formatting of std::ostream, without its
+// per-call overhead. Numbers are printed with std::to_chars like the
+// default ostream precision, so the text is the same byte for byte
+class OutputBuffer {
+public:
+    OutputBuffer() = default;
+
+    OutputBuffer& operator<<(std::string_view str);
+    OutputBuffer& operator<<(const char* str);
+    OutputBuffer& operator<<(char c);
+    OutputBuffer& operator<<(double value);
+    OutputBuffer& operator<<(int value);
+    OutputBuffer& operator<<(uint32_t value);
+    OutputBuffer& operator<<(const Color& color);
+    OutputBuffer& operator<<(StrokeLineCap cap);
+    OutputBuffer& operator<<(StrokeLineJoin join);
+
+    std::string_view GetText() const;
+    std::string Extract();
+    // Writes the text to the stream in one call and empties the buffer
+    void Flush(std::ostream& out);
+
+private:
+    std::string text_;
+};
+
 struct RenderContext {
     RenderContext(std::ostream& out_)
         : out(out_) {
@@ -105,6 +151,7 @@ struct RenderContext {
 };
 
 class Object;
+class CompactDocument;
 
 class ObjectContainer {
 public:
@@ -141,27 +188,27 @@ template <typename Owner>
 class PathProps {
 public:
     Owner& SetFillColor(Color color) {
-        fill_color_ = std::move(color);
+        style_.fill_color = std::move(color);
         return AsOwner();
     }
 
     Owner& SetStrokeColor(Color color) {
-        stroke_color_ = std::move(color);
+        style_.stroke_color = std::move(color);
         return AsOwner();
     }
 
     Owner& SetStrokeWidth(double width) {
-        stroke_width_ = width;
+        style_.stroke_width = width;
         return AsOwner();
     }
 
     Owner& SetStrokeLineCap(StrokeLineCap cap) {
-        stroke_line_cap_ = cap;
+        style_.stroke_line_cap = cap;
         return AsOwner();
     }
 
     Owner& SetStrokeLineJoin(StrokeLineJoin join) {
-        stroke_line_join_ = join;
+        style_.stroke_line_join = join;
         return AsOwner();
     }
 
@@ -169,35 +216,17 @@ protected:
     ~PathProps() = default;
 
     void RenderAttrs(std::ostream& out) const {
-        using namespace std::literals;
-
-        if (fill_color_) {
-            out << " fill=\""sv << *fill_color_ << "\""sv;
-        }
-        if (stroke_color_) {
-            out << " stroke=\""sv << *stroke_color_ << "\""sv;
-        }
-        if (stroke_width_) {
-            out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
-        }
-        if (stroke_line_cap_) {
-            out << " stroke-linecap=\""sv << *stroke_line_cap_ << "\""sv;
-        }
-        if (stroke_line_join_) {
-            out << " stroke-linejoin=\""sv << *stroke_line_join_ << "\""sv;
-        }
+        RenderPathStyle(out, style_);
     }
 
+    PathStyle style_;
+
 private:
+    friend class CompactDocument;
+
     Owner& AsOwner() {
         return static_cast<Owner&>(*this);
     }
-
-    std::optional<Color> fill_color_;
-    std::optional<Color> stroke_color_;
-    std::optional<StrokeLineCap> stroke_line_cap_;
-    std::optional<StrokeLineJoin> stroke_line_join_;
-    std::optional<double> stroke_width_;
 };
 
 class Circle final : public Object, public PathProps<Circle> {
@@ -208,6 +237,8 @@ public:
     Circle& SetRadius(double radius);
 
 private:
+    friend class CompactDocument;
+
     void RenderObject(const RenderContext& context) const override;
 
     Point center_;
@@ -223,6 +254,8 @@ public:
     void RenderObject(const RenderContext& context) const override;
 
 private:
+    friend class CompactDocument;
+
     std::vector<Point> points_;
 };
 
@@ -242,6 +275,8 @@ public:
     void RenderObject(const RenderContext& context) const override;
 
 private:
+    friend class CompactDocument;
+
     std::string data_;
     Point pos_;
     Point offset_;
@@ -255,6 +290,7 @@ public:
     Document() = default;
 
     void AddPtr(std::unique_ptr<Object>&& obj) override;
+    void Clear();
 
     void Render(std::ostream& out) const;
 
@@ -262,4 +298,74 @@ private:
     std::vector<std::unique_ptr<Object>> objects_;
 };
 
+// Document that keeps shapes by value instead of one heap object each.
+// Every kind of shape has its own array, points of all polylines share one
+// array, and text strings and path styles are stored once and referred to
+// by index. Shapes are built with the usual setters and copied in by Add.
+// Renders the same text as Document with the same shapes.
+class CompactDocument {
+public:
+    CompactDocument() = default;
+
+    void Add(const Circle& circle);
+    void Add(const Polyline& polyline);
+    void Add(const Text& text);
+    void Clear();
+
+    void Render(std::ostream& out) const;
+    void Render(OutputBuffer& out) const;
+
+private:
+    using StringId = uint32_t;
+    using StyleId = uint32_t;
+
+    enum class Kind : uint8_t {
+        CIRCLE,
+        POLYLINE,
+        TEXT,
+    };
+
+    // Position of a shape in the array of its kind, in drawing order
+    struct ObjectRef {
+        Kind kind;
+        uint32_t index;
+    };
+
+    struct CircleRecord {
+        Point center;
+        double radius;
+        StyleId style;
+    };
+
+    struct PolylineRecord {
+        uint32_t first_point;
+        uint32_t points_count;
+        StyleId style;
+    };
+
+    struct TextRecord {
+        Point pos;
+        Point offset;
+        uint32_t font_size;
+        StringId font_family;
+        StringId font_weight;
+        StringId data;
+        StyleId style;
+    };
+
+    StringId InternString(std::string_view str);
+    StyleId InternStyle(const PathStyle& style);
+
+    std::vector<ObjectRef> objects_;
+    std::vector<CircleRecord> circles_;
+    std::vector<PolylineRecord> polylines_;
+    std::vector<Point> points_;
+    std::vector<TextRecord> texts_;
+
+    // Deque keeps the strings in place, so that the keys stay valid
+    std::deque<std::string> strings_;
+    std::unordered_map<std::string_view, StringId> string_ids_;
+    std::vector<PathStyle> styles_;
+};
+
 }  // namespace svg
\ No newline at end of file
@@ -0,0 +1,180 @@
+// Checks that TransportRouter::Update after AddStop, AddBus, RemoveBus and
+// SetStopsDistance gives the same routes as a router built from scratch, in
+// every router mode and graph model, and that a router refuses to build
+// routes until it is updated.
+//
+// Build from this directory:
+//     g++ -std=c++20 -O2 -pthread -I.. router_update.cpp ../transport_catalogue.cpp ../transport_router.cpp
+//         ../serialization.cpp ../map_renderer.cpp ../svg.cpp ../domain.cpp ../geo.cpp ../json.cpp
+//         ../mapped_file.cpp -o router_update
+// Usage: router_update [seed] [steps]
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+using namespace std::literals;
+
+namespace {
+
+constexpr int STOPS = 40;
+constexpr int BUSES = 12;
+constexpr int QUERIES = 60;
+
+std::vector<std::string_view> MakeRouteStops(const TransportCatalogue& catalogue, std::mt19937& generator, bool is_roundtrip) {
+    const auto names = catalogue.GetStopsNames();
+    std::vector<std::string_view> stops;
+    const size_t size = 2 + generator() % 5;
+    for (size_t i = 0; i < size; ++i) {
+        stops.push_back(names[generator() % names.size()]);
+    }
+    if (is_roundtrip) {
+        stops.push_back(stops.front());
+    }
+    return stops;
+}
+
+void FillCatalogue(TransportCatalogue& catalogue, std::mt19937& generator) {
+    std::uniform_real_distribution<double> offset(0.0, 0.05);
+    for (int stop = 0; stop < STOPS; ++stop) {
+        catalogue.AddStop("Stop "s + std::to_string(stop), geo::Coordinates{55.6 + offset(generator), 37.5 + offset(generator)});
+    }
+    for (int bus = 0; bus < BUSES; ++bus) {
+        const bool is_roundtrip = generator() % 2;
+        catalogue.AddBus("Bus "s + std::to_string(bus), MakeRouteStops(catalogue, generator, is_roundtrip), is_roundtrip);
+    }
+    catalogue.Finalize();
+}
+
+// One random change of the catalogue. A new stop is not on any bus yet, and
+// RIDE_VERTICES rebuilds the whole router for it
+void ChangeCatalogue(TransportCatalogue& catalogue, std::mt19937& generator, int& next_name) {
+    const auto stops = catalogue.GetStopsNames();
+    const auto buses = catalogue.GetBusesNames();
+    switch (generator() % 4) {
+        case 0: {
+            const auto& near = catalogue.GetStop(stops[generator() % stops.size()])->coordinates;
+            catalogue.AddStop("New stop "s + std::to_string(next_name++), geo::Coordinates{near.lat + 0.001, near.lng});
+            break;
+        }
+        case 1: {
+            const bool is_roundtrip = generator() % 2;
+            catalogue.AddBus("New bus "s + std::to_string(next_name++), MakeRouteStops(catalogue, generator, is_roundtrip), is_roundtrip);
+            break;
+        }
+        case 2:
+            if (!buses.empty()) {
+                catalogue.RemoveBus(buses[generator() % buses.size()]);
+            }
+            break;
+        default:
+            if (!buses.empty()) {
+                const Bus* bus = catalogue.GetBus(buses[generator() % buses.size()]);
+                const size_t i = generator() % (bus->stops.size() - 1);
+                catalogue.SetStopsDistance(catalogue.GetStop(bus->stops[i])->name,
+                                           catalogue.GetStop(bus->stops[i + 1])->name,
+                                           100.0 + generator() % 5000);
+            }
+    }
+}
+
+// Routes may differ in the items when several are equally fast
+bool IsSameRoute(const std::optional<RouteInfo>& updated, const std::optional<RouteInfo>& fresh) {
+    if (updated.has_value() != fresh.has_value()) {
+        return false;
+    }
+    if (!updated) {
+        return true;
+    }
+    const double total_time = fresh->total_time.count();
+    if (std::abs(updated->total_time.count() - total_time) > 1e-9 * std::max(1.0, total_time)) {
+        return false;
+    }
+    double items_time = 0;
+    for (const auto& item : updated->items) {
+        std::visit([&items_time](const auto& value) {
+            items_time += value.time.count();
+        }, item);
+    }
+    return std::abs(items_time - total_time) < 1e-6 * std::max(1.0, total_time);
+}
+
+int CheckUpdates(std::string_view mode, std::string_view model, unsigned seed, int steps) {
+    std::mt19937 generator(seed);
+    TransportCatalogue catalogue;
+    FillCatalogue(catalogue, generator);
+
+    const json::Dict settings{
+        {"bus_wait_time"s, json::Node(6)},
+        {"bus_velocity"s, json::Node(40)},
+        {"router_mode"s, json::Node(std::string(mode))},
+        {"graph_model"s, json::Node(std::string(model))},
+        {"route_cache_size"s, json::Node(100)},
+    };
+    TransportRouter router(catalogue, settings);
+
+    int failures = 0;
+    int next_name = 0;
+    for (int step = 0; step < steps; ++step) {
+        const uint64_t version = catalogue.GetVersion();
+        ChangeCatalogue(catalogue, generator, next_name);
+
+        const auto stops = catalogue.GetStopsNames();
+        if (catalogue.GetVersion() != version) {
+            try {
+                router.BuildRoute(stops.front(), stops.back());
+                std::cerr << mode << "/" << model << ": built a route before Update\n";
+                ++failures;
+            } catch (const std::logic_error&) {
+            }
+        }
+
+        if (generator() % 2) {
+            catalogue.Finalize();
+        }
+        router.Update();
+        const TransportRouter fresh(catalogue, settings);
+
+        for (int query = 0; query < QUERIES; ++query) {
+            const auto from = stops[generator() % stops.size()];
+            const auto to = stops[generator() % stops.size()];
+            if (!IsSameRoute(router.BuildRoute(from, to), fresh.BuildRoute(from, to))) {
+                std::cerr << mode << "/" << model << ": step " << step << ", route "
+                          << from << " - " << to << " differs from a fresh router\n";
+                ++failures;
+            }
+        }
+    }
+    return failures;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const unsigned seed = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 1;
+    const int steps = argc > 2 ? std::atoi(argv[2]) : 30;
+
+    int failures = 0;
+    for (const auto mode : {"all_pairs"sv, "blocked_all_pairs"sv, "on_demand"sv}) {
+        for (const auto model : {"stop_pairs"sv, "ride_vertices"sv}) {
+            failures += CheckUpdates(mode, model, seed, steps);
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " failures\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
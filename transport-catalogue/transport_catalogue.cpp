@@ -1,26 +1,77 @@
 #include "transport_catalogue.h"
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <thread>
+
+namespace {
+
+constexpr double DEGREES_PER_RADIAN = 180.0 / 3.14159265358979323846;
+
+// Lat/lng box holding every point within radius meters of center
+spatial::Box BoxAround(geo::Coordinates center, double radius) {
+    const double lat_delta = radius / geo::EARTH_RADIUS * DEGREES_PER_RADIAN;
+    const double max_lat = std::abs(center.lat) + lat_delta;
+    // Near a pole every longitude may be close
+    const double lng_delta = max_lat < 89.0
+        ? lat_delta / std::cos(max_lat / DEGREES_PER_RADIAN)
+        : 360.0;
+    return {center.lng - lng_delta, center.lat - lat_delta, center.lng + lng_delta, center.lat + lat_delta};
+}
+
+uint64_t DistanceKey(StopId from, StopId to) {
+    return static_cast<uint64_t>(from) << 32 | to;
+}
+
+}  // namespace
 
 void TransportCatalogue::AddStop(const std::string& name, const geo::Coordinates& coordinates) noexcept {
     stops_.emplace_back(name, coordinates);
+    stops_.back().id = static_cast<StopId>(stops_.size() - 1);
     stop_by_name_[stops_.back().name] = &stops_.back();
+    buses_by_stop_.emplace_back();
+    stops_grid_.Insert(coordinates.lng, coordinates.lat, &stops_.back());
+    changes_.push_back(StopAdded{stops_.back().id});
 }
 
 void TransportCatalogue::AddBus(const std::string& name,
     const std::vector<std::string_view>& stops,
     bool is_roundtrip) noexcept {
     buses_.emplace_back(name);
+    buses_.back().id = static_cast<BusId>(buses_.size() - 1);
     buses_.back().is_roundtrip = is_roundtrip;
 
+    buses_.back().stops.reserve(stops.size());
     for (const auto& s : stops) {
-        auto stop = stop_by_name_.at(s);
+        const StopId stop = stop_by_name_.at(s)->id;
         buses_.back().stops.push_back(stop);
 
         buses_by_stop_[stop].insert(&buses_.back());
     }
 
     bus_by_name_[buses_.back().name] = &buses_.back();
+    removed_buses_.push_back(false);
+    bus_routes_.emplace_back();
+    stale_buses_.push_back(buses_.back().id);
+    bus_routes_ready_ = false;
+    changes_.push_back(BusAdded{buses_.back().id});
+}
+
+bool TransportCatalogue::RemoveBus(std::string_view name) {
+    const auto it = bus_by_name_.find(name);
+    if (it == bus_by_name_.end()) {
+        return false;
+    }
+
+    Bus* bus = it->second;
+    bus_by_name_.erase(it);
+    for (const StopId stop : bus->stops) {
+        buses_by_stop_[stop].erase(bus);
+    }
+    removed_buses_[bus->id] = true;
+    bus_routes_[bus->id] = BusRoute{};
+    changes_.push_back(BusRemoved{bus->id});
+    return true;
 }
 
 void TransportCatalogue::SetStopsDistance(std::string_view name1 , std::string_view name2, double distance) noexcept {
@@ -28,27 +79,106 @@ void TransportCatalogue::SetStopsDistance(std::string_view name1 , std::string_v
     auto stop2 = GetStop(name2);
 
     if (stop1 && stop2) {
-        stop_to_stop_distance_[{stop1, stop2}] = distance;
+        stop_to_stop_distance_[DistanceKey(stop1->id, stop2->id)] = distance;
+        distances_frozen_ = false;
+        // Either direction of the pair may be looked up in the other one
+        for (const Bus* bus : buses_by_stop_[stop1->id]) {
+            stale_buses_.push_back(bus->id);
+            bus_routes_ready_ = false;
+        }
+        changes_.push_back(DistanceChanged{stop1->id, stop2->id});
     }
 }
 
+void TransportCatalogue::FreezeDistances() {
+    struct Entry {
+        StopId from;
+        StopId to;
+        double distance;
+    };
+
+    std::vector<Entry> entries;
+    entries.reserve(stop_to_stop_distance_.size() * 2);
+    for (const auto& [key, distance] : stop_to_stop_distance_) {
+        const auto from = static_cast<StopId>(key >> 32);
+        const auto to = static_cast<StopId>(key & UINT32_MAX);
+        entries.push_back({from, to, distance});
+        if (stop_to_stop_distance_.count(DistanceKey(to, from)) == 0) {
+            entries.push_back({to, from, distance});
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return std::pair{lhs.from, lhs.to} < std::pair{rhs.from, rhs.to};
+    });
+
+    distance_offsets_.assign(stops_.size() + 1, 0);
+    distance_neighbors_.clear();
+    distance_values_.clear();
+    distance_neighbors_.reserve(entries.size());
+    distance_values_.reserve(entries.size());
+    for (const auto& entry : entries) {
+        ++distance_offsets_[entry.from + 1];
+        distance_neighbors_.push_back(entry.to);
+        distance_values_.push_back(entry.distance);
+    }
+    for (size_t i = 1; i < distance_offsets_.size(); ++i) {
+        distance_offsets_[i] += distance_offsets_[i - 1];
+    }
+    distances_frozen_ = true;
+}
+
+void TransportCatalogue::Finalize() {
+    if (!distances_frozen_) {
+        FreezeDistances();
+    }
+    UpdateBusRoutes();
+}
+
 double TransportCatalogue::GetStopsDistance(std::string_view name1, std::string_view name2) const noexcept {
     auto stop1 = GetStop(name1);
     auto stop2 = GetStop(name2);
     
     if (stop1 && stop2) {
-        if (stop_to_stop_distance_.count({stop1, stop2}) > 0) {
-            return stop_to_stop_distance_.at({stop1, stop2});
-        } else if (stop_to_stop_distance_.count({stop2, stop1}) > 0) {
-            return stop_to_stop_distance_.at({stop2, stop1});
-        } else {
-            return geo::ComputeDistance(stop1->coordinates, stop2->coordinates);
-        }
+        return GetStopsDistance(stop1->id, stop2->id);
     }
 
     return -1;
 }
 
+double TransportCatalogue::GetStopsDistance(StopId from, StopId to) const noexcept {
+    if (from >= stops_.size() || to >= stops_.size()) {
+        return -1;
+    }
+
+    if (distances_frozen_) {
+        // Stops added after the freeze have no distances yet
+        if (from + 1 < distance_offsets_.size()) {
+            const auto begin = distance_neighbors_.begin() + static_cast<std::ptrdiff_t>(distance_offsets_[from]);
+            const auto end = distance_neighbors_.begin() + static_cast<std::ptrdiff_t>(distance_offsets_[from + 1]);
+            if (const auto it = std::lower_bound(begin, end, to); it != end && *it == to) {
+                return distance_values_[static_cast<size_t>(it - distance_neighbors_.begin())];
+            }
+        }
+        return geo::ComputeDistance(stops_[from].coordinates, stops_[to].coordinates);
+    }
+
+    if (const auto it = stop_to_stop_distance_.find(DistanceKey(from, to)); it != stop_to_stop_distance_.end()) {
+        return it->second;
+    } else if (const auto it = stop_to_stop_distance_.find(DistanceKey(to, from)); it != stop_to_stop_distance_.end()) {
+        return it->second;
+    }
+    return geo::ComputeDistance(stops_[from].coordinates, stops_[to].coordinates);
+}
+
+std::vector<std::tuple<std::string_view, std::string_view, double>> TransportCatalogue::GetStopsDistances() const {
+    std::vector<std::tuple<std::string_view, std::string_view, double>> distances;
+    distances.reserve(stop_to_stop_distance_.size());
+    for (const auto& [key, distance] : stop_to_stop_distance_) {
+        distances.emplace_back(stops_[key >> 32].name, stops_[key & UINT32_MAX].name, distance);
+    }
+    return distances;
+}
+
 const Stop* TransportCatalogue::GetStop(std::string_view name) const noexcept {
     if (stop_by_name_.count(name) == 0)
         return nullptr;
@@ -63,6 +193,14 @@ const Bus* TransportCatalogue::GetBus(std::string_view name) const noexcept {
     return bus_by_name_.at(name);
 }
 
+const Stop* TransportCatalogue::GetStop(StopId id) const noexcept {
+    return id < stops_.size() ? &stops_[id] : nullptr;
+}
+
+const Bus* TransportCatalogue::GetBus(BusId id) const noexcept {
+    return id < buses_.size() && !removed_buses_[id] ? &buses_[id] : nullptr;
+}
+
 std::vector<std::string_view> TransportCatalogue::GetStopsNames() const noexcept {
     std::vector<std::string_view> names;
     names.reserve(stops_.size());
@@ -76,7 +214,9 @@ std::vector<std::string_view> TransportCatalogue::GetBusesNames() const noexcept
     std::vector<std::string_view> names;
     names.reserve(buses_.size());
     for (const auto& bus : buses_) {
-        names.push_back(bus.name);
+        if (!removed_buses_[bus.id]) {
+            names.push_back(bus.name);
+        }
     }
     return names;
 }
@@ -85,64 +225,137 @@ size_t TransportCatalogue::GetStopsCount() const noexcept {
     return stops_.size();
 }
 
-std::unordered_set<Bus*> TransportCatalogue::GetBusesByStop(const Stop* stop) const {
-    if (buses_by_stop_.count(stop_by_name_.at(stop->name)) == 0)
-        return {};
+size_t TransportCatalogue::GetBusesCount() const noexcept {
+    return buses_.size();
+}
 
-    return buses_by_stop_.at(stop_by_name_.at(stop->name));
+uint64_t TransportCatalogue::GetVersion() const noexcept {
+    return changes_.size();
+}
+
+std::span<const TransportCatalogue::Change> TransportCatalogue::GetChangesSince(uint64_t version) const noexcept {
+    return std::span(changes_).subspan(std::min<size_t>(version, changes_.size()));
+}
+
+std::unordered_set<Bus*> TransportCatalogue::GetBusesByStop(const Stop* stop) const {
+    return buses_by_stop_.at(stop->id);
 }
 
 std::vector<std::string_view> TransportCatalogue::GetStopsByBus(std::string_view bus) const {
     std::vector<std::string_view> stops;
     stops.reserve(GetBus(bus)->stops.size());
-    for (const auto& stop : GetBus(bus)->stops) {
-        stops.push_back(stop->name);
+    for (const StopId stop : GetBus(bus)->stops) {
+        stops.push_back(stops_[stop].name);
     }
     return stops;
 }
 
-std::optional<BusStat> TransportCatalogue::GetBusStat(std::string_view bus_name) const noexcept {
-    BusStat stat;
+std::optional<BusStat> TransportCatalogue::GetBusStat(std::string_view bus_name) const {
     auto bus = GetBus(bus_name);
 
     if (bus == nullptr) {
         return std::nullopt;
     }
-     
-    stat.stop_count = static_cast<int>(bus->stops.size());
-    if (!bus->is_roundtrip) {
-        stat.stop_count = stat.stop_count * 2 - 1;
+    return GetBusStat(bus->id);
+}
+
+std::optional<BusStat> TransportCatalogue::GetBusStat(BusId bus_id) const {
+    if (GetBus(bus_id) == nullptr) {
+        return std::nullopt;
     }
-    
-    std::unordered_set<std::string_view> unique_stops;
-    for (const auto& stop : bus->stops) {
-        unique_stops.emplace(stop->name);
+
+    UpdateBusRoutes();
+    return bus_routes_[bus_id].stat;
+}
+
+double TransportCatalogue::GetRouteDistance(BusId bus, size_t from, size_t to) const {
+    if (GetBus(bus) == nullptr) {
+        return -1;
     }
-    stat.unique_stop_count = static_cast<int>(unique_stops.size());
-    
-    double fact_bus_length = 0, geo_bus_length = 0;
-    for (size_t i = 0; i < bus->stops.size() - 1; ++i) {
-        auto current_stop = bus->stops[i];
-        auto next_stop = bus->stops[i + 1];
-        
-        fact_bus_length += geo::ComputeDistance(current_stop->coordinates, next_stop->coordinates);
-        geo_bus_length += GetStopsDistance(current_stop->name, next_stop->name);
-    }
-
-    if (!bus->is_roundtrip) {
-        for (size_t i = bus->stops.size() - 1; i > 0; --i) {
-            auto current_stop = bus->stops[i];
-            auto next_stop = bus->stops[i - 1];
-            
-            fact_bus_length += geo::ComputeDistance(current_stop->coordinates, next_stop->coordinates);
-            geo_bus_length += GetStopsDistance(current_stop->name, next_stop->name);
+
+    UpdateBusRoutes();
+    const auto& road = bus_routes_[bus].road;
+    if (from > to || to >= road.size()) {
+        return -1;
+    }
+    return road[to] - road[from];
+}
+
+// Buses are split between threads like the rows of graph::BlockedRouter
+void TransportCatalogue::UpdateBusRoutes() const {
+    if (bus_routes_ready_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard lock(bus_routes_mutex_);
+    if (bus_routes_ready_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::sort(stale_buses_.begin(), stale_buses_.end());
+    stale_buses_.erase(std::unique(stale_buses_.begin(), stale_buses_.end()), stale_buses_.end());
+
+    const size_t thread_count = std::clamp<size_t>(
+        std::thread::hardware_concurrency(), 1, (stale_buses_.size() + BUSES_PER_THREAD - 1) / BUSES_PER_THREAD);
+    auto worker = [this, thread_count](size_t first) {
+        for (size_t i = first; i < stale_buses_.size(); i += thread_count) {
+            UpdateBusRoute(stale_buses_[i]);
         }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t first = 1; first < thread_count; ++first) {
+        threads.emplace_back(worker, first);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    stale_buses_.clear();
+    bus_routes_ready_.store(true, std::memory_order_release);
+}
+
+// The sums run along the route in riding order, the way a bus goes there and back
+void TransportCatalogue::UpdateBusRoute(BusId bus_id) const {
+    if (removed_buses_[bus_id]) {
+        return;
+    }
+    const Bus& bus = buses_[bus_id];
+    auto& bus_route = bus_routes_[bus_id];
+
+    std::vector<StopId> route = bus.stops;
+    if (!bus.is_roundtrip && !route.empty()) {
+        route.insert(route.end(), std::next(bus.stops.rbegin()), bus.stops.rend());
+    }
+
+    bus_route.road.clear();
+    bus_route.geo.clear();
+    bus_route.road.reserve(route.size());
+    bus_route.geo.reserve(route.size());
+    double road_length = 0, geo_length = 0;
+    for (size_t i = 0; i < route.size(); ++i) {
+        if (i > 0) {
+            road_length += GetStopsDistance(route[i - 1], route[i]);
+            geo_length += geo::ComputeDistance(stops_[route[i - 1]].coordinates, stops_[route[i]].coordinates);
+        }
+        bus_route.road.push_back(road_length);
+        bus_route.geo.push_back(geo_length);
+    }
+
+    BusStat& stat = bus_route.stat;
+    stat.stop_count = static_cast<int>(bus.stops.size());
+    if (!bus.is_roundtrip) {
+        stat.stop_count = stat.stop_count * 2 - 1;
     }
 
-    stat.bus_length = geo_bus_length;
-    stat.curvature = geo_bus_length / fact_bus_length;
+    std::vector<StopId> unique_stops = bus.stops;
+    std::sort(unique_stops.begin(), unique_stops.end());
+    stat.unique_stop_count = static_cast<int>(std::unique(unique_stops.begin(), unique_stops.end()) - unique_stops.begin());
 
-    return stat;
+    stat.bus_length = road_length;
+    stat.curvature = road_length / geo_length;
 }
 
 size_t TransportCatalogue::GetSpanCount(
@@ -151,6 +364,16 @@ size_t TransportCatalogue::GetSpanCount(
     std::string_view to_stop
 ) const noexcept {
     auto bus = GetBus(bus_name);
+    auto from = GetStop(from_stop);
+    auto to = GetStop(to_stop);
+    if (bus == nullptr || from == nullptr || to == nullptr) {
+        return 0;
+    }
+    return GetSpanCount(bus->id, from->id, to->id);
+}
+
+size_t TransportCatalogue::GetSpanCount(BusId bus_id, StopId from_stop, StopId to_stop) const noexcept {
+    auto bus = GetBus(bus_id);
     if (bus == nullptr) {
         return 0;
     }
@@ -159,22 +382,22 @@ size_t TransportCatalogue::GetSpanCount(
 
     if (bus->is_roundtrip) {
         for (size_t i = 0; i < bus->stops.size() - 1; ++i) {
-            if (bus->stops[i]->name == from_stop) {
+            if (bus->stops[i] == from_stop) {
                 from = i;
             }
         }
         for (size_t i = 1; i < bus->stops.size(); ++i) {
-            if (bus->stops[i]->name == to_stop) {
+            if (bus->stops[i] == to_stop) {
                 to = i;
                 break;
             }
         }
     } else {
         for (size_t i = 0; i < bus->stops.size(); ++i) {
-            if (bus->stops[i]->name == from_stop) {
+            if (bus->stops[i] == from_stop) {
                 from = i;
             }
-            if (bus->stops[i]->name == to_stop) {
+            if (bus->stops[i] == to_stop) {
                 to = i;
             }
         }
@@ -182,3 +405,78 @@ size_t TransportCatalogue::GetSpanCount(
 
     return to - from;
 }
+
+std::vector<const Stop*> TransportCatalogue::FindNearestStops(geo::Coordinates point, size_t count) const {
+    if (count == 0 || stops_grid_.GetItemsCount() == 0) {
+        return {};
+    }
+    count = std::min(count, stops_grid_.GetItemsCount());
+
+    // Widen the box until it holds enough stops. The farthest of them bounds
+    // the distance to the nearest ones, which may lie outside the box
+    double half_side = STOPS_GRID_CELL;
+    std::vector<const Stop*> candidates;
+    while (true) {
+        candidates.clear();
+        const spatial::Box box{point.lng - half_side, point.lat - half_side, point.lng + half_side, point.lat + half_side};
+        stops_grid_.ForEachInBox(box, [&candidates](const Stop* stop) {
+            candidates.push_back(stop);
+        });
+        if (candidates.size() >= count) {
+            break;
+        }
+        half_side *= 2;
+    }
+
+    std::vector<double> distances;
+    distances.reserve(candidates.size());
+    for (const Stop* stop : candidates) {
+        distances.push_back(geo::ComputeDistance(point, stop->coordinates));
+    }
+    std::nth_element(distances.begin(), distances.begin() + static_cast<std::ptrdiff_t>(count - 1), distances.end());
+
+    auto stops = FindStopsAround(point, distances[count - 1]);
+    stops.resize(std::min(stops.size(), count));
+    return stops;
+}
+
+std::vector<const Stop*> TransportCatalogue::FindStopsInRadius(geo::Coordinates center, double radius) const {
+    return FindStopsAround(center, radius);
+}
+
+std::vector<const Stop*> TransportCatalogue::FindStopsInBox(geo::Coordinates first_corner, geo::Coordinates second_corner) const {
+    const spatial::Box box{
+        std::min(first_corner.lng, second_corner.lng),
+        std::min(first_corner.lat, second_corner.lat),
+        std::max(first_corner.lng, second_corner.lng),
+        std::max(first_corner.lat, second_corner.lat)
+    };
+    std::vector<const Stop*> stops;
+    stops_grid_.ForEachInBox(box, [&stops](const Stop* stop) {
+        stops.push_back(stop);
+    });
+    std::sort(stops.begin(), stops.end(), [](const Stop* lhs, const Stop* rhs) {
+        return lhs->name < rhs->name;
+    });
+    return stops;
+}
+
+std::vector<const Stop*> TransportCatalogue::FindStopsAround(geo::Coordinates center, double radius) const {
+    std::vector<std::pair<double, const Stop*>> found;
+    stops_grid_.ForEachInBox(BoxAround(center, radius), [&found, center, radius](const Stop* stop) {
+        const double distance = geo::ComputeDistance(center, stop->coordinates);
+        if (distance <= radius) {
+            found.emplace_back(distance, stop);
+        }
+    });
+    std::sort(found.begin(), found.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first != rhs.first ? lhs.first < rhs.first : lhs.second->name < rhs.second->name;
+    });
+
+    std::vector<const Stop*> stops;
+    stops.reserve(found.size());
+    for (const auto& [distance, stop] : found) {
+        stops.push_back(stop);
+    }
+    return stops;
+}
@@ -1,70 +1,167 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <deque>
 #include <set>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
+#include <variant>
 
 #include "geo.h"
 #include "domain.h"
+#include "spatial_index.h"
 
 class TransportCatalogue {
 public:
+    // Changes of the catalogue in the order they were made, one per version.
+    // Derived data like TransportRouter reads the changes made since the
+    // version it was built for and updates itself
+    struct StopAdded {
+        StopId stop;
+    };
+    struct BusAdded {
+        BusId bus;
+    };
+    struct BusRemoved {
+        BusId bus;
+    };
+    struct DistanceChanged {
+        StopId from;
+        StopId to;
+    };
+    using Change = std::variant<StopAdded, BusAdded, BusRemoved, DistanceChanged>;
+
     TransportCatalogue() = default;
 
     void AddStop(const std::string& name, const geo::Coordinates& coordinates) noexcept; 
     void AddBus(const std::string& name,
         const std::vector<std::string_view>& stops,
         bool is_roundtrip = false) noexcept;
+    // The id of a removed bus is not reused, GetBus and GetBusStat give
+    // nullptr for it. False for an unknown bus
+    bool RemoveBus(std::string_view name);
 
     void SetStopsDistance(std::string_view first, std::string_view second, double distance) noexcept;
+    // Copies the distances to a table sorted by stop ids, which GetStopsDistance
+    // searches until the next SetStopsDistance. Call once the distances are set
+    void FreezeDistances();
+    // Freezes the distances and computes the route distances and stats of the
+    // buses added or changed since the last call, in parallel. Otherwise the
+    // first read of them does it, so call it once the catalogue is filled
+    void Finalize();
 
     const Stop* GetStop(std::string_view name) const noexcept;
     const Bus* GetBus(std::string_view name) const noexcept;
+    // nullptr for an id out of range or a removed bus
+    const Stop* GetStop(StopId id) const noexcept;
+    const Bus* GetBus(BusId id) const noexcept;
 
     std::vector<std::string_view> GetStopsNames() const noexcept;
     std::vector<std::string_view> GetBusesNames() const noexcept;
 
     size_t GetStopsCount() const noexcept;
+    // Bus ids are below it, removed buses included
+    size_t GetBusesCount() const noexcept;
+
+    // Grows on every change, so that derived data can tell it is stale
+    uint64_t GetVersion() const noexcept;
+    // Changes made after the version, the oldest first
+    std::span<const Change> GetChangesSince(uint64_t version) const noexcept;
 
     double GetStopsDistance(std::string_view name1, std::string_view name2) const noexcept;
+    double GetStopsDistance(StopId from, StopId to) const noexcept;
     double GetStopsDefaultDistance(std::string_view name1, std::string_view name2) const noexcept;
 
-    std::optional<BusStat> GetBusStat(std::string_view bus_name) const noexcept;
+    // Every distance set with SetStopsDistance, in unspecified order
+    std::vector<std::tuple<std::string_view, std::string_view, double>> GetStopsDistances() const;
+
+    // Copy of the cached stats, empty for an unknown bus. Stale stats are
+    // recomputed first, on several threads, which may throw
+    std::optional<BusStat> GetBusStat(std::string_view bus_name) const;
+    std::optional<BusStat> GetBusStat(BusId bus) const;
+
+    // Road distance along the bus between two positions of its route, from
+    // before to. A non-roundtrip route goes there and back, so its position
+    // stops.size() - 1 + k is the stop stops.size() - 1 - k on the way back.
+    // Recomputes stale routes like GetBusStat
+    double GetRouteDistance(BusId bus, size_t from, size_t to) const;
 
     std::unordered_set<Bus*> GetBusesByStop(const Stop* stop) const;
     std::vector<std::string_view> GetStopsByBus(std::string_view bus) const;
 
+    // Up to count stops closest to the point, nearest first
+    std::vector<const Stop*> FindNearestStops(geo::Coordinates point, size_t count) const;
+    // Stops not farther than radius meters from the center, nearest first
+    std::vector<const Stop*> FindStopsInRadius(geo::Coordinates center, double radius) const;
+    // Stops inside the lat/lng box between two corners, by name
+    std::vector<const Stop*> FindStopsInBox(geo::Coordinates first_corner, geo::Coordinates second_corner) const;
+
     size_t GetSpanCount(
         std::string_view bus_name,
         std::string_view from_stop,
         std::string_view to_stop
     ) const noexcept;
+    size_t GetSpanCount(BusId bus, StopId from, StopId to) const noexcept;
 
 private:
-    double StopsDistance(const Stop* stop1, const Stop* stop2) const noexcept;
+    // About a kilometer along a meridian
+    static constexpr double STOPS_GRID_CELL = 0.01;
+    // A thread is not worth starting for fewer buses
+    static constexpr size_t BUSES_PER_THREAD = 64;
+
+    // Stops within radius meters, nearest first, ties by name
+    std::vector<const Stop*> FindStopsAround(geo::Coordinates center, double radius) const;
+    // Brings the routes of the stale buses up to date, safe to call from
+    // several threads at once
+    void UpdateBusRoutes() const;
+    void UpdateBusRoute(BusId bus) const;
+
+    // The version is the number of changes
+    std::vector<Change> changes_;
 
     std::deque<Bus> buses_;
+    // Indexed by BusId
+    std::vector<bool> removed_buses_;
     std::deque<Stop> stops_;
 
     std::unordered_map<std::string_view, Stop*> stop_by_name_;
     std::unordered_map<std::string_view, Bus*> bus_by_name_;
 
-    std::unordered_map<Stop*, std::unordered_set<Bus*>> buses_by_stop_;
+    // Indexed by StopId
+    std::vector<std::unordered_set<Bus*>> buses_by_stop_;
 
-    struct PairStopStopHash {
-        size_t operator()(const std::pair<const Stop*, const Stop*>& pair) const {
-           return std::hash<const Stop*>()(pair.first) ^ std::hash<const Stop*>()(pair.second);
-       }
+    // Road and geographic distances from the start of each bus route to
+    // every position of it, and the stats of the bus, by BusId
+    struct BusRoute {
+        std::vector<double> road;
+        std::vector<double> geo;
+        BusStat stat{};
     };
-
-    std::unordered_map<
-        std::pair<const Stop*, const Stop*>,
-        double,
-        PairStopStopHash>
-            stop_to_stop_distance_;
+    mutable std::vector<BusRoute> bus_routes_;
+    // Buses added or passing by a changed distance since the last update
+    mutable std::vector<BusId> stale_buses_;
+    mutable std::atomic<bool> bus_routes_ready_ = true;
+    mutable std::mutex bus_routes_mutex_;
+
+    // Stops by coordinates, lng along x and lat along y
+    spatial::HashGrid<const Stop*> stops_grid_{STOPS_GRID_CELL};
+
+    // Keyed by the pair of stop ids packed into one number
+    std::unordered_map<uint64_t, double> stop_to_stop_distance_;
+
+    // Frozen stop_to_stop_distance_: the distances from stop X lie in
+    // [distance_offsets_[X], distance_offsets_[X + 1]) of the two arrays below,
+    // sorted by neighbour, with the reverse distance where only that one is set
+    bool distances_frozen_ = false;
+    std::vector<size_t> distance_offsets_;
+    std::vector<StopId> distance_neighbors_;
+    std::vector<double> distance_values_;
 };
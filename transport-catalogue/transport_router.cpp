@@ -1,85 +1,629 @@
 #include "transport_router.h"
+#include "serialization.h"
+#include "parallel.h"
+
+#include <iterator>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
+RouterMode AsRouterMode(const json::Dict& settings) {
+    using namespace std::literals;
+
+    if (settings.count("router_mode"s) == 0) {
+        return RouterMode::ALL_PAIRS;
+    }
+
+    const auto& mode = settings.at("router_mode"s).AsString();
+    if (mode == "all_pairs"s) {
+        return RouterMode::ALL_PAIRS;
+    } else if (mode == "blocked_all_pairs"s) {
+        return RouterMode::BLOCKED_ALL_PAIRS;
+    } else if (mode == "on_demand"s) {
+        return RouterMode::ON_DEMAND;
+    }
+    throw std::invalid_argument("Unknown router_mode '"s + mode + "'"s);
+}
+
+GraphModel AsGraphModel(const json::Dict& settings) {
+    using namespace std::literals;
+
+    if (settings.count("graph_model"s) == 0) {
+        return GraphModel::STOP_PAIRS;
+    }
+
+    const auto& model = settings.at("graph_model"s).AsString();
+    if (model == "stop_pairs"s) {
+        return GraphModel::STOP_PAIRS;
+    } else if (model == "ride_vertices"s) {
+        return GraphModel::RIDE_VERTICES;
+    }
+    throw std::invalid_argument("Unknown graph_model '"s + model + "'"s);
+}
+
+namespace {
+
+size_t CountGraphVertices(const TransportCatalogue& catalogue, GraphModel model) {
+    if (model == GraphModel::STOP_PAIRS) {
+        return catalogue.GetStopsCount() * 2;
+    }
+
+    size_t vertex_count = catalogue.GetStopsCount();
+    for (BusId id = 0; id < catalogue.GetBusesCount(); ++id) {
+        if (const Bus* bus = catalogue.GetBus(id)) {
+            vertex_count += bus->is_roundtrip ? bus->stops.size() : bus->stops.size() * 2;
+        }
+    }
+    return vertex_count;
+}
+
+// STOP_PAIRS has two vertices per stop. Every ride vertex is on an edge, and
+// an edge joins two vertices at most, so a snapshot with more ride vertices
+// than twice the edges it has room for is corrupt
+size_t ReadVertexCount(serialization::Reader& reader, const TransportCatalogue& catalogue, GraphModel model) {
+    using namespace std::literals;
+
+    const size_t vertex_count = reader.ReadSize();
+    const size_t stops_count = catalogue.GetStopsCount();
+    const bool is_valid = model == GraphModel::STOP_PAIRS
+        ? vertex_count == stops_count * 2
+        : vertex_count >= stops_count
+            && vertex_count - stops_count <= reader.GetRemainingSize() / sizeof(graph::Edge<Minutes>) * 2;
+    if (!is_valid) {
+        throw serialization::FormatError("Vertex count doesn't match the catalogue"s);
+    }
+    return vertex_count;
+}
+
+uint64_t RouteKey(StopId from, StopId to) {
+    return uint64_t{from} << 32 | to;
+}
+
+}  // namespace
+
 TransportRouter::TransportRouter(const TransportCatalogue& catalogue, const json::Dict& settings)
     : catalogue_(catalogue)
-    , graph_(catalogue.GetStopsCount() * 2)
+    , graph_model_(AsGraphModel(settings))
+    , graph_(CountGraphVertices(catalogue, graph_model_))
 {
     using namespace std::literals;
 
-    std::vector<std::string_view> stops = catalogue.GetStopsNames();
-
     waiting_time_ = Minutes(settings.at("bus_wait_time"s).AsDouble());
     bus_velocity_ = settings.at("bus_velocity"s).AsDouble();
+    if (settings.count("walking_speed"s) > 0) {
+        walking_speed_ = settings.at("walking_speed"s).AsDouble();
+    }
+    if (settings.count("walking_stops_count"s) > 0) {
+        walking_stops_count_ = static_cast<size_t>(settings.at("walking_stops_count"s).AsInt());
+    }
+    if (settings.count("route_cache_size"s) > 0) {
+        if (const auto size = settings.at("route_cache_size"s).AsInt(); size > 0) {
+            route_cache_.emplace(static_cast<size_t>(size));
+        }
+    }
+
+    catalogue_version_ = catalogue_.GetVersion();
+    BuildGraph();
+    BuildRouter(AsRouterMode(settings));
+}
 
-    for (size_t i = 0; i < catalogue.GetStopsCount() * 2; i += 2) {
-        stop_index_by_name_[stops[i / 2].data()] = i + 1;
-        stop_name_by_index_[i + 1] = stops[i / 2].data();
+// Members are read in declaration order: graph model, then vertex count
+TransportRouter::TransportRouter(const TransportCatalogue& catalogue, serialization::Reader& reader)
+    : catalogue_(catalogue)
+    , graph_model_(static_cast<GraphModel>(reader.Read<uint8_t>()))
+    , graph_(ReadVertexCount(reader, catalogue, graph_model_))
+{
+    using namespace std::literals;
 
-        auto wait = stops[i / 2].data() + " wait"s;
-        stop_index_by_name_[wait] = i;
-        stop_name_by_index_[i] = wait;
+    if (graph_model_ != GraphModel::STOP_PAIRS && graph_model_ != GraphModel::RIDE_VERTICES) {
+        throw serialization::FormatError("Unknown graph model"s);
+    }
 
-        graph_.AddEdge(graph::Edge{i, i + 1, waiting_time_});
-        ++edge_id_;
+    catalogue_version_ = catalogue_.GetVersion();
+    waiting_time_ = Minutes{reader.Read<double>()};
+    bus_velocity_ = reader.Read<double>();
+    walking_speed_ = reader.Read<double>();
+    walking_stops_count_ = reader.ReadSize();
+    if (const auto route_cache_size = reader.ReadSize(); route_cache_size > 0) {
+        route_cache_.emplace(route_cache_size);
     }
 
-    for (auto bus : catalogue_.GetBusesNames()) {
-        if (catalogue_.GetBus(bus)->is_roundtrip) {
-            for (size_t i = 0; i < catalogue_.GetBus(bus)->stops.size(); ++i) {
-                const auto& from = catalogue_.GetBus(bus)->stops[i]->name;
-                double distance = 0;
-                for (size_t j = i + 1; j < catalogue_.GetBus(bus)->stops.size(); ++j) {
-                    const auto& prev = catalogue_.GetBus(bus)->stops[j - 1]->name;
-                    const auto& to = catalogue_.GetBus(bus)->stops[j]->name;
+    for (const auto& edge : reader.ReadVector<graph::Edge<Minutes>>()) {
+        graph_.AddEdge(edge);
+    }
+    graph_.Freeze();
 
-                    distance += catalogue_.GetStopsDistance(prev, to);
-                    AddEdge(from, to, distance, bus);
-                }
+    auto read_index = [&reader](size_t count, std::string_view what) {
+        const auto index = reader.Read<uint64_t>();
+        if (index >= count) {
+            throw serialization::FormatError(std::string(what) + " index is out of range"s);
+        }
+        return static_cast<uint32_t>(index);
+    };
+
+    if (reader.ReadSize() != graph_.GetEdgeCount()) {
+        throw serialization::FormatError("Edge infos don't match the graph"s);
+    }
+    edge_infos_.reserve(graph_.GetEdgeCount());
+    for (size_t edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        EdgeInfo info{};
+        info.kind = static_cast<EdgeDescription::Kind>(reader.Read<uint8_t>());
+        if (info.kind != EdgeDescription::Kind::WAIT && info.kind != EdgeDescription::Kind::RIDE
+            && info.kind != EdgeDescription::Kind::ALIGHT) {
+            throw serialization::FormatError("Unknown edge kind"s);
+        }
+        info.from = read_index(catalogue_.GetStopsCount(), "Stop"sv);
+        info.to = read_index(catalogue_.GetStopsCount(), "Stop"sv);
+        info.bus = read_index(std::max<size_t>(catalogue_.GetBusesCount(), 1), "Bus"sv);
+        info.span_count = reader.Read<uint32_t>();
+        edge_infos_.push_back(info);
+    }
+
+    DeserializeRouter(reader);
+}
+
+void TransportRouter::Serialize(serialization::Writer& writer) const {
+    writer.Write(static_cast<uint8_t>(graph_model_));
+    writer.WriteSize(graph_.GetVertexCount());
+    writer.Write(waiting_time_.count());
+    writer.Write(bus_velocity_);
+    writer.Write(walking_speed_);
+    writer.WriteSize(walking_stops_count_);
+    writer.WriteSize(route_cache_ ? route_cache_->GetCapacity() : 0);
+
+    std::vector<graph::Edge<Minutes>> edges;
+    edges.reserve(graph_.GetEdgeCount());
+    for (graph::EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        edges.push_back(graph_.GetEdge(edge_id));
+    }
+    writer.WriteVector(edges);
+
+    // The catalogue is stored without the removed buses, which shifts the
+    // ids of the later ones
+    std::vector<uint64_t> bus_index(catalogue_.GetBusesCount(), 0);
+    for (BusId bus = 0, index = 0; bus < catalogue_.GetBusesCount(); ++bus) {
+        if (catalogue_.GetBus(bus) != nullptr) {
+            bus_index[bus] = index++;
+        }
+    }
+
+    // Field by field, so that no padding gets into the snapshot
+    writer.WriteSize(edge_infos_.size());
+    for (const auto& info : edge_infos_) {
+        writer.Write(static_cast<uint8_t>(info.kind));
+        writer.Write(uint64_t{info.from});
+        writer.Write(uint64_t{info.to});
+        writer.Write(info.bus < bus_index.size() ? bus_index[info.bus] : uint64_t{0});
+        writer.Write(info.span_count);
+    }
+
+    SerializeRouter(writer);
+}
+
+// Both all-pairs routers are stored as the flat matrices of BlockedRouter
+void TransportRouter::SerializeRouter(serialization::Writer& writer) const {
+    if (std::holds_alternative<graph::Router<Minutes>>(router_)) {
+        writer.Write(static_cast<uint8_t>(RouterMode::ALL_PAIRS));
+    } else if (std::holds_alternative<graph::BlockedRouter<Minutes>>(router_)) {
+        writer.Write(static_cast<uint8_t>(RouterMode::BLOCKED_ALL_PAIRS));
+    } else {
+        writer.Write(static_cast<uint8_t>(RouterMode::ON_DEMAND));
+        return;
+    }
+
+    const auto tables = GetRouteTables();
+    writer.WriteVector(tables->weights);
+    writer.WriteVector(tables->prev_edges);
+}
+
+void TransportRouter::DeserializeRouter(serialization::Reader& reader) {
+    using namespace std::literals;
+    using BlockedRouter = graph::BlockedRouter<Minutes>;
+
+    const auto mode = static_cast<RouterMode>(reader.Read<uint8_t>());
+    switch (mode) {
+        case RouterMode::ALL_PAIRS:
+        case RouterMode::BLOCKED_ALL_PAIRS: {
+            RouteTables tables;
+            tables.weights = reader.ReadVector<BlockedRouter::Value>();
+            tables.prev_edges = reader.ReadVector<graph::EdgeId>();
+
+            const size_t vertex_count = graph_.GetVertexCount();
+            if (tables.weights.size() != vertex_count * vertex_count || tables.prev_edges.size() != tables.weights.size()) {
+                throw serialization::FormatError("Route tables don't match the graph"s);
             }
-        } else {
-            for (size_t i = 0; i < catalogue_.GetBus(bus)->stops.size(); ++i) {
-                const auto& from = catalogue_.GetBus(bus)->stops[i]->name;
-                double distance = 0;
-                for (size_t j = i + 1; j < catalogue_.GetBus(bus)->stops.size(); ++j) {
-                    const auto& prev = catalogue_.GetBus(bus)->stops[j - 1]->name;
-                    const auto& to = catalogue_.GetBus(bus)->stops[j]->name;
-
-                    distance += catalogue_.GetStopsDistance(prev, to);
-                    AddEdge(from, to, distance, bus);
-                }
+            SetRouteTables(mode, std::move(tables));
+            break;
+        }
+        case RouterMode::ON_DEMAND:
+            router_.emplace<graph::DijkstraRouter<Minutes>>(graph_);
+            break;
+        default:
+            throw serialization::FormatError("Unknown router mode"s);
+    }
+}
+
+// ALL_PAIRS gets its tables out of the flat matrices
+void TransportRouter::SetRouteTables(RouterMode mode, RouteTables tables) {
+    using BlockedRouter = graph::BlockedRouter<Minutes>;
+
+    if (mode == RouterMode::BLOCKED_ALL_PAIRS) {
+        router_.emplace<BlockedRouter>(graph_, std::move(tables.weights), std::move(tables.prev_edges));
+        return;
+    }
+
+    const size_t vertex_count = graph_.GetVertexCount();
+    graph::Router<Minutes>::RoutesInternalData routes(
+        vertex_count,
+        std::vector<std::optional<graph::Router<Minutes>::RouteInternalData>>(vertex_count));
+    for (size_t from = 0; from < vertex_count; ++from) {
+        for (size_t to = 0; to < vertex_count; ++to) {
+            const size_t cell = from * vertex_count + to;
+            if (tables.weights[cell] < BlockedRouter::Traits::Infinity()) {
+                routes[from][to] = graph::Router<Minutes>::RouteInternalData{
+                    Minutes{tables.weights[cell]},
+                    tables.prev_edges[cell] == BlockedRouter::NO_EDGE
+                        ? std::nullopt
+                        : std::optional<graph::EdgeId>{tables.prev_edges[cell]}
+                };
             }
-            for (int i = static_cast<int>(catalogue_.GetBus(bus)->stops.size()) - 1; i >= 0; --i) {
-                const auto& from = catalogue_.GetBus(bus)->stops[static_cast<size_t>(i)]->name;
-                double distance = 0;
-                for (int j = i - 1; j >= 0; --j) {
-                    const auto& prev = catalogue_.GetBus(bus)->stops[static_cast<size_t>(j + 1)]->name;
-                    const auto& to = catalogue_.GetBus(bus)->stops[static_cast<size_t>(j)]->name;
-
-                    distance += catalogue_.GetStopsDistance(prev, to);
-                    AddEdge(from, to, distance, bus);
-                }
+        }
+    }
+    router_.emplace<graph::Router<Minutes>>(graph_, std::move(routes));
+}
+
+void TransportRouter::BuildGraph() {
+    if (graph_model_ == GraphModel::STOP_PAIRS) {
+        for (StopId stop = 0; stop < catalogue_.GetStopsCount(); ++stop) {
+            AddEdge(MakeWaitEdge(stop));
+        }
+    }
+
+    graph::VertexId next_ride_vertex = catalogue_.GetStopsCount();
+    for (BusId bus = 0; bus < catalogue_.GetBusesCount(); ++bus) {
+        if (catalogue_.GetBus(bus) == nullptr) {
+            continue;
+        }
+        for (const auto& edge : MakeBusEdges(bus, next_ride_vertex)) {
+            AddEdge(edge);
+        }
+        next_ride_vertex += CountRideVertices(bus);
+    }
+    graph_.Freeze();
+}
+
+void TransportRouter::BuildRouter(RouterMode mode) {
+    switch (mode) {
+        case RouterMode::ALL_PAIRS:
+            router_.emplace<graph::Router<Minutes>>(graph_);
+            break;
+        case RouterMode::BLOCKED_ALL_PAIRS:
+            router_.emplace<graph::BlockedRouter<Minutes>>(graph_);
+            break;
+        case RouterMode::ON_DEMAND:
+            router_.emplace<graph::DijkstraRouter<Minutes>>(graph_);
+            break;
+    }
+}
+
+RouterMode TransportRouter::GetRouterMode() const {
+    if (std::holds_alternative<graph::Router<Minutes>>(router_)) {
+        return RouterMode::ALL_PAIRS;
+    } else if (std::holds_alternative<graph::BlockedRouter<Minutes>>(router_)) {
+        return RouterMode::BLOCKED_ALL_PAIRS;
+    }
+    return RouterMode::ON_DEMAND;
+}
+
+// In STOP_PAIRS, from the wait vertex of the stop to the stop vertex
+TransportRouter::InfoEdge TransportRouter::MakeWaitEdge(StopId stop) const {
+    const graph::VertexId vertex = GetStopVertex(stop);
+    return {graph::Edge{vertex - 1, vertex, waiting_time_}, EdgeInfo{EdgeDescription::Kind::WAIT, stop, stop}};
+}
+
+// On the way back stop i of a non-roundtrip bus is at route position 2 * (n - 1) - i
+std::vector<TransportRouter::InfoEdge> TransportRouter::MakeBusEdges(BusId bus, graph::VertexId first_ride_vertex) const {
+    const auto& stops = catalogue_.GetBus(bus)->stops;
+    const bool is_roundtrip = catalogue_.GetBus(bus)->is_roundtrip;
+
+    std::vector<InfoEdge> edges;
+    if (graph_model_ == GraphModel::RIDE_VERTICES) {
+        AddRideChain(bus, stops.begin(), stops.end(), first_ride_vertex, edges);
+        if (!is_roundtrip) {
+            AddRideChain(bus, stops.rbegin(), stops.rend(), first_ride_vertex, edges);
+        }
+        return edges;
+    }
+
+    // Edge distances are running sums of the segments, not differences of
+    // the catalogue prefix sums: those round differently, and a bus would
+    // lose ties it wins now. Segments are looked up once per bus
+    std::vector<double> segments(stops.size());
+    for (size_t i = 1; i < stops.size(); ++i) {
+        segments[i] = catalogue_.GetStopsDistance(stops[i - 1], stops[i]);
+    }
+    for (size_t i = 0; i < stops.size(); ++i) {
+        double distance = 0;
+        for (size_t j = i + 1; j < stops.size(); ++j) {
+            distance += segments[j];
+            edges.push_back(MakeStopPairsEdge(stops[i], stops[j], distance, bus, j - i));
+        }
+    }
+    if (!is_roundtrip) {
+        for (size_t i = 1; i < stops.size(); ++i) {
+            segments[i] = catalogue_.GetStopsDistance(stops[i], stops[i - 1]);
+        }
+        for (size_t i = stops.size(); i-- > 0;) {
+            double distance = 0;
+            for (size_t j = i; j-- > 0;) {
+                distance += segments[j + 1];
+                edges.push_back(MakeStopPairsEdge(stops[i], stops[j], distance, bus, i - j));
             }
         }
     }
+    return edges;
+}
+
+size_t TransportRouter::CountRideVertices(BusId bus) const {
+    if (graph_model_ != GraphModel::RIDE_VERTICES) {
+        return 0;
+    }
+    const Bus* found = catalogue_.GetBus(bus);
+    return found->is_roundtrip ? found->stops.size() : found->stops.size() * 2;
+}
+
+template <typename StopIt>
+void TransportRouter::AddRideChain(BusId bus, StopIt begin, StopIt end, graph::VertexId& next_ride_vertex,
+                                   std::vector<InfoEdge>& edges) const {
+    using Kind = EdgeDescription::Kind;
+
+    graph::VertexId prev_ride_vertex = 0;
+    for (auto it = begin; it != end; ++it) {
+        const graph::VertexId stop_vertex = GetStopVertex(*it);
+        const graph::VertexId ride_vertex = next_ride_vertex++;
+
+        // Nobody boards at the last stop of a chain or alights at the first one
+        if (std::next(it) != end) {
+            edges.push_back({graph::Edge{stop_vertex, ride_vertex, waiting_time_}, EdgeInfo{Kind::WAIT, *it, *it, bus}});
+        }
+        if (it != begin) {
+            const double distance = catalogue_.GetStopsDistance(*std::prev(it), *it);
+            edges.push_back({graph::Edge{prev_ride_vertex, ride_vertex, Minutes{distance / 1000 / bus_velocity_ * 60}},
+                             EdgeInfo{Kind::RIDE, *std::prev(it), *it, bus, 1}});
+            edges.push_back({graph::Edge{ride_vertex, stop_vertex, Minutes{0}}, EdgeInfo{Kind::ALIGHT, *it, *it, bus}});
+        }
+        prev_ride_vertex = ride_vertex;
+    }
+}
 
-    router_.emplace(graph_);
+void TransportRouter::AddEdge(const InfoEdge& edge) {
+    graph_.AddEdge(edge.edge);
+    edge_infos_.push_back(edge.info);
 }
 
-void TransportRouter::AddEdge(
-    std::string_view from,
-    std::string_view to,
+// Bus edges go from the stop vertex to the wait vertex of the target
+TransportRouter::InfoEdge TransportRouter::MakeStopPairsEdge(
+    StopId from,
+    StopId to,
     double distance,
-    std::string_view bus
-) {
-    graph_.AddEdge(
+    BusId bus,
+    size_t span_count
+) const {
+    return {
         graph::Edge{
-            GetStopIndexByName(from.data()),
-            GetStopIndexByName(to.data()) - 1,
+            GetStopVertex(from),
+            GetStopVertex(to) - 1,
             Minutes{distance / 1000 / bus_velocity_ * 60}
+        },
+        EdgeInfo{EdgeDescription::Kind::RIDE, from, to, bus, static_cast<uint32_t>(span_count)}
+    };
+}
+
+bool TransportRouter::IsBusEdge(const EdgeInfo& info) const {
+    return graph_model_ == GraphModel::RIDE_VERTICES || info.kind == EdgeDescription::Kind::RIDE;
+}
+
+void TransportRouter::Rebuild() {
+    const RouterMode mode = GetRouterMode();
+    router_.emplace<std::monostate>();
+    edge_infos_.clear();
+    graph_ = graph::DirectedWeightedGraph<Minutes>(CountGraphVertices(catalogue_, graph_model_));
+    BuildGraph();
+    BuildRouter(mode);
+}
+
+// Buses with changed distances keep their edges with new weights, edges of
+// removed buses go, and added stops and buses get new edges at the end. Edge
+// ids are renumbered without the removed edges. Ride vertices of removed
+// buses stay unused until the next rebuild. A stop added in RIDE_VERTICES
+// would renumber the ride vertices, so it rebuilds the router
+void TransportRouter::Update() {
+    using Catalogue = TransportCatalogue;
+
+    const auto changes = catalogue_.GetChangesSince(catalogue_version_);
+    if (changes.empty()) {
+        return;
+    }
+    catalogue_version_ = catalogue_.GetVersion();
+    if (route_cache_) {
+        route_cache_->Clear();
+    }
+
+    std::vector<bool> is_stale_bus(catalogue_.GetBusesCount(), false);
+    std::vector<bool> is_added_bus(catalogue_.GetBusesCount(), false);
+    size_t added_stops = 0;
+    for (const auto& change : changes) {
+        if (std::holds_alternative<Catalogue::StopAdded>(change)) {
+            ++added_stops;
+        } else if (std::holds_alternative<Catalogue::BusAdded>(change)) {
+            is_stale_bus[std::get<Catalogue::BusAdded>(change).bus] = true;
+            is_added_bus[std::get<Catalogue::BusAdded>(change).bus] = true;
+        } else if (std::holds_alternative<Catalogue::BusRemoved>(change)) {
+            is_stale_bus[std::get<Catalogue::BusRemoved>(change).bus] = true;
+        } else {
+            // Either direction of the pair may be looked up in the other one,
+            // and a bus through it passes the first stop either way
+            const auto& distance = std::get<Catalogue::DistanceChanged>(change);
+            for (const Bus* bus : catalogue_.GetBusesByStop(catalogue_.GetStop(distance.from))) {
+                is_stale_bus[bus->id] = true;
+            }
         }
-    );
-    bus_by_edge_id_[edge_id_++] = bus;
+    }
+    if (added_stops > 0 && graph_model_ == GraphModel::RIDE_VERTICES) {
+        Rebuild();
+        return;
+    }
+
+    std::vector<std::vector<graph::EdgeId>> stale_edges(catalogue_.GetBusesCount());
+    for (graph::EdgeId edge_id = 0; edge_id < edge_infos_.size(); ++edge_id) {
+        if (IsBusEdge(edge_infos_[edge_id]) && is_stale_bus[edge_infos_[edge_id].bus]) {
+            stale_edges[edge_infos_[edge_id].bus].push_back(edge_id);
+        }
+    }
+
+    // Edges of a bus come in the order MakeBusEdges gives them, so the new
+    // weights go to them in the same order. Edges of removed buses get none
+    const size_t old_vertex_count = graph_.GetVertexCount();
+    size_t vertex_count = old_vertex_count + (graph_model_ == GraphModel::STOP_PAIRS ? added_stops * 2 : 0);
+    std::vector<std::optional<Minutes>> new_weights(edge_infos_.size());
+    std::vector<std::pair<BusId, graph::VertexId>> added_buses;
+    for (BusId bus = 0; bus < catalogue_.GetBusesCount(); ++bus) {
+        if (!is_stale_bus[bus] || catalogue_.GetBus(bus) == nullptr) {
+            continue;
+        }
+        if (is_added_bus[bus]) {
+            added_buses.emplace_back(bus, vertex_count);
+            vertex_count += CountRideVertices(bus);
+            continue;
+        }
+        if (stale_edges[bus].empty()) {
+            continue;
+        }
+        const graph::VertexId first_ride_vertex = graph_.GetEdge(stale_edges[bus].front()).to;
+        const auto edges = MakeBusEdges(bus, first_ride_vertex);
+        if (edges.size() != stale_edges[bus].size()) {
+            throw std::logic_error("Bus edges don't match the graph");
+        }
+        for (size_t i = 0; i < edges.size(); ++i) {
+            new_weights[stale_edges[bus][i]] = edges[i].edge.weight;
+        }
+    }
+
+    // Routes through the heavier and removed edges may change, and so may
+    // the ones the lighter and new edges can shorten
+    UpdatedEdges updated_edges;
+    updated_edges.new_ids.assign(edge_infos_.size(), graph::BlockedRouter<Minutes>::NO_EDGE);
+    updated_edges.is_heavier.assign(edge_infos_.size(), false);
+
+    graph::DirectedWeightedGraph<Minutes> graph(vertex_count);
+    std::vector<EdgeInfo> edge_infos;
+    auto add_edge = [&graph, &edge_infos](const graph::Edge<Minutes>& edge, const EdgeInfo& info) {
+        edge_infos.push_back(info);
+        return graph.AddEdge(edge);
+    };
+
+    for (graph::EdgeId edge_id = 0; edge_id < edge_infos_.size(); ++edge_id) {
+        auto edge = graph_.GetEdge(edge_id);
+        const auto& info = edge_infos_[edge_id];
+        if (IsBusEdge(info) && is_stale_bus[info.bus]) {
+            if (!new_weights[edge_id]) {
+                updated_edges.is_heavier[edge_id] = true;
+                continue;
+            }
+            updated_edges.is_heavier[edge_id] = edge.weight < *new_weights[edge_id];
+            const bool is_lighter = *new_weights[edge_id] < edge.weight;
+            edge.weight = *new_weights[edge_id];
+            updated_edges.new_ids[edge_id] = add_edge(edge, info);
+            if (is_lighter) {
+                updated_edges.lighter.push_back(updated_edges.new_ids[edge_id]);
+            }
+        } else {
+            updated_edges.new_ids[edge_id] = add_edge(edge, info);
+        }
+    }
+    for (size_t stop = catalogue_.GetStopsCount() - added_stops; stop < catalogue_.GetStopsCount(); ++stop) {
+        const auto edge = MakeWaitEdge(static_cast<StopId>(stop));
+        updated_edges.lighter.push_back(add_edge(edge.edge, edge.info));
+    }
+    for (const auto& [bus, first_ride_vertex] : added_buses) {
+        for (const auto& edge : MakeBusEdges(bus, first_ride_vertex)) {
+            updated_edges.lighter.push_back(add_edge(edge.edge, edge.info));
+        }
+    }
+
+    const RouterMode mode = GetRouterMode();
+    const auto old_tables = GetRouteTables();
+    router_.emplace<std::monostate>();
+    graph_ = std::move(graph);
+    edge_infos_ = std::move(edge_infos);
+    graph_.Freeze();
+
+    if (old_tables) {
+        SetRouteTables(mode, UpdateRouteTables(*old_tables, old_vertex_count, updated_edges));
+    } else {
+        BuildRouter(mode);
+    }
+}
+
+// A row is kept when no route of it goes through a heavier edge and no
+// lighter edge gets to its end vertex faster. Then its weights still bound
+// every edge of the graph, so no route of the row can get shorter
+TransportRouter::RouteTables TransportRouter::UpdateRouteTables(const RouteTables& old_tables,
+                                                                size_t old_vertex_count,
+                                                                const UpdatedEdges& updated_edges) const {
+    using BlockedRouter = graph::BlockedRouter<Minutes>;
+
+    const size_t vertex_count = graph_.GetVertexCount();
+    std::vector<bool> is_stale_row(vertex_count, true);
+    for (size_t from = 0; from < old_vertex_count; ++from) {
+        const double* weights = old_tables.weights.data() + from * old_vertex_count;
+        const graph::EdgeId* prev_edges = old_tables.prev_edges.data() + from * old_vertex_count;
+
+        bool is_stale = false;
+        for (size_t to = 0; to < old_vertex_count && !is_stale; ++to) {
+            is_stale = prev_edges[to] != BlockedRouter::NO_EDGE && updated_edges.is_heavier[prev_edges[to]];
+        }
+        for (size_t i = 0; i < updated_edges.lighter.size() && !is_stale; ++i) {
+            const auto& edge = graph_.GetEdge(updated_edges.lighter[i]);
+            if (edge.from < old_vertex_count && weights[edge.from] < BlockedRouter::Traits::Infinity()) {
+                const double weight = weights[edge.from] + edge.weight.count();
+                is_stale = edge.to >= old_vertex_count || weight < weights[edge.to];
+            }
+        }
+        is_stale_row[from] = is_stale;
+    }
+
+    RouteTables tables{
+        std::vector<double>(vertex_count * vertex_count, BlockedRouter::Traits::Infinity()),
+        std::vector<graph::EdgeId>(vertex_count * vertex_count, BlockedRouter::NO_EDGE)
+    };
+    std::vector<size_t> stale_rows;
+    for (size_t from = 0; from < vertex_count; ++from) {
+        if (is_stale_row[from]) {
+            stale_rows.push_back(from);
+            continue;
+        }
+        for (size_t to = 0; to < old_vertex_count; ++to) {
+            const size_t old_cell = from * old_vertex_count + to;
+            tables.weights[from * vertex_count + to] = old_tables.weights[old_cell];
+            if (old_tables.prev_edges[old_cell] != BlockedRouter::NO_EDGE) {
+                tables.prev_edges[from * vertex_count + to] = updated_edges.new_ids[old_tables.prev_edges[old_cell]];
+            }
+        }
+    }
+
+    const graph::DijkstraRouter<Minutes> dijkstra(graph_);
+    parallel::ForEachIndex(stale_rows.size(), std::thread::hardware_concurrency(), [&](size_t index) {
+        const size_t from = stale_rows[index];
+        const auto tree = dijkstra.BuildTree(from);
+        for (size_t to = 0; to < vertex_count; ++to) {
+            if (tree[to]) {
+                tables.weights[from * vertex_count + to] = tree[to]->weight.count();
+                tables.prev_edges[from * vertex_count + to] = tree[to]->prev_edge.value_or(BlockedRouter::NO_EDGE);
+            }
+        }
+    });
+    return tables;
 }
 
 std::optional<RouteInfo> TransportRouter::BuildRoute(std::string_view stop_from, std::string_view stop_to) const {
@@ -87,81 +631,390 @@ std::optional<RouteInfo> TransportRouter::BuildRoute(std::string_view stop_from,
         return RouteInfo{};
     }
 
-    auto stop_from_index = GetStopIndexByName(stop_from.data());
-    auto stop_to_index = GetStopIndexByName(stop_to.data());
+    const Stop* from = catalogue_.GetStop(stop_from);
+    const Stop* to = catalogue_.GetStop(stop_to);
+    if (from == nullptr || to == nullptr) {
+        return std::nullopt;
+    }
+    return BuildRoute(from->id, to->id);
+}
+
+std::optional<RouteInfo> TransportRouter::BuildRoute(StopId stop_from, StopId stop_to) const {
+    CheckUpToDate();
+    if (stop_from == stop_to) {
+        return RouteInfo{};
+    }
+    if (route_cache_) {
+        if (auto cached_route = route_cache_->Find(RouteKey(stop_from, stop_to))) {
+            return std::move(*cached_route);
+        }
+    }
 
-    if (auto built_route = router_->BuildRoute(stop_from_index, stop_to_index)) {
-        using namespace std::literals;
+    std::optional<RouteInfo> route;
+    if (auto built_route = BuildGraphRoute(GetStopVertex(stop_from), GetStopVertex(stop_to))) {
+        route = UnpackRoute(stop_from, *built_route);
+    }
+    if (route_cache_) {
+        route_cache_->Put(RouteKey(stop_from, stop_to), route);
+    }
+    return route;
+}
 
-        RouteInfo route;
+std::vector<std::optional<RouteInfo>> TransportRouter::BuildRoutes(StopId stop_from, std::span<const StopId> stops_to) const {
+    CheckUpToDate();
+    std::vector<std::optional<RouteInfo>> routes;
+    routes.reserve(stops_to.size());
+    if (!std::holds_alternative<graph::DijkstraRouter<Minutes>>(router_)) {
+        for (const StopId stop_to : stops_to) {
+            routes.push_back(BuildRoute(stop_from, stop_to));
+        }
+        return routes;
+    }
 
-        route.items.push_back(
-            RouteInfo::WaitItem{
-                .stop = stop_from,
-                .time = GetBusWaitingTime(),
+    // Only the routes missing from the cache are searched for
+    std::vector<size_t> searched;
+    std::vector<graph::VertexId> targets;
+    for (size_t i = 0; i < stops_to.size(); ++i) {
+        if (stops_to[i] == stop_from) {
+            routes.push_back(RouteInfo{});
+            continue;
+        }
+        if (route_cache_) {
+            if (auto cached_route = route_cache_->Find(RouteKey(stop_from, stops_to[i]))) {
+                routes.push_back(std::move(*cached_route));
+                continue;
             }
-        );
+        }
+        routes.push_back(std::nullopt);
+        searched.push_back(i);
+        targets.push_back(GetStopVertex(stops_to[i]));
+    }
+    if (targets.empty()) {
+        return routes;
+    }
+
+    auto built_routes = std::get<graph::DijkstraRouter<Minutes>>(router_).BuildRoutes(GetStopVertex(stop_from), targets);
+    for (size_t i = 0; i < searched.size(); ++i) {
+        auto& route = routes[searched[i]];
+        if (built_routes[i]) {
+            route = UnpackRoute(stop_from, *built_routes[i]);
+        }
+        if (route_cache_) {
+            route_cache_->Put(RouteKey(stop_from, stops_to[searched[i]]), route);
+        }
+    }
+    return routes;
+}
+
+TransportRouter::RouteCache::Stats TransportRouter::GetRouteCacheStats() const {
+    return route_cache_ ? route_cache_->GetStats() : RouteCache::Stats{};
+}
+
+std::optional<RouteInfo> TransportRouter::BuildWalkingRoute(const RoutePoint& from, const RoutePoint& to) const {
+    CheckUpToDate();
+    if (std::holds_alternative<std::string_view>(from) && std::holds_alternative<std::string_view>(to)) {
+        return BuildRoute(std::get<std::string_view>(from), std::get<std::string_view>(to));
+    }
 
-        Minutes total_time = GetBusWaitingTime();
+    const auto sources = FindAccessStops(from);
+    const auto targets = FindAccessStops(to);
+    if (sources.empty() || targets.empty()) {
+        return std::nullopt;
+    }
 
-        for (size_t i = 1; i < built_route->edges.size(); ++i) {
-            auto edge = built_route->edges[i - 1];
+    // A stop end has its only access stop, with no walk
+    const bool walk_from = std::holds_alternative<geo::Coordinates>(from);
+    const bool walk_to = std::holds_alternative<geo::Coordinates>(to);
+    const geo::Coordinates from_coordinates = walk_from ? std::get<geo::Coordinates>(from) : sources.front().stop->coordinates;
+    const geo::Coordinates to_coordinates = walk_to ? std::get<geo::Coordinates>(to) : targets.front().stop->coordinates;
 
-            auto [from_sv, to_sv] = GetStopsByEdgeId(edge);
-            std::string from = std::string(from_sv);
-            std::string to = std::string(to_sv);
+    RouteInfo route;
+    route.total_time = GetWalkingTime(from_coordinates, to_coordinates);
+    route.items.push_back(
+        RouteInfo::WalkItem{
+            .from = walk_from ? std::string_view{} : sources.front().stop->name,
+            .to = walk_to ? std::string_view{} : targets.front().stop->name,
+            .time = route.total_time
+        }
+    );
+
+    const auto terminal_route = BuildTerminalRoute(sources, targets);
+    if (!terminal_route) {
+        return route;
+    }
+    const StopAccess& source = sources[terminal_route->source];
+    const StopAccess& target = targets[terminal_route->target];
+    if (!(source.walk + terminal_route->route.weight + target.walk < route.total_time)) {
+        return route;
+    }
 
-            if (std::optional<std::string_view> bus = GetBusByEdgeId(edge)) {
-                total_time += GetEdgeWeight(edge);
+    RouteInfo ride;
+    if (source.stop != target.stop) {
+        switch (graph_model_) {
+            case GraphModel::STOP_PAIRS:
+                ride = UnpackStopPairsRoute(source.stop->id, terminal_route->route);
+                break;
+            case GraphModel::RIDE_VERTICES:
+                ride = UnpackRideRoute(terminal_route->route);
+                break;
+        }
+    }
 
-                if (from.ends_with(" wait"s)) from.erase(from.size() - 5);
-                if (to.ends_with(" wait"s)) to.erase(to.size() - 5);
-                route.items.push_back(
-                    RouteInfo::BusItem{
-                        .bus = *bus,
-                        .span_count = catalogue_.GetSpanCount(*bus, from, to),
-                        .time = GetEdgeWeight(edge)
-                    }
-                );
-            } else if (from.ends_with(" wait"s)) {
-                total_time += GetBusWaitingTime();
+    route.items.clear();
+    if (walk_from) {
+        route.items.push_back(RouteInfo::WalkItem{.from = {}, .to = source.stop->name, .time = source.walk});
+    }
+    route.items.insert(route.items.end(), ride.items.begin(), ride.items.end());
+    if (walk_to) {
+        route.items.push_back(RouteInfo::WalkItem{.from = target.stop->name, .to = {}, .time = target.walk});
+    }
+    route.total_time = source.walk + ride.total_time + target.walk;
+    return route;
+}
 
+std::vector<TransportRouter::StopAccess> TransportRouter::FindAccessStops(const RoutePoint& point) const {
+    if (std::holds_alternative<std::string_view>(point)) {
+        if (const Stop* stop = catalogue_.GetStop(std::get<std::string_view>(point))) {
+            return {StopAccess{stop, Minutes{0}}};
+        }
+        return {};
+    }
+
+    const auto& coordinates = std::get<geo::Coordinates>(point);
+    std::vector<StopAccess> stops;
+    for (const Stop* stop : catalogue_.FindNearestStops(coordinates, walking_stops_count_)) {
+        stops.push_back(StopAccess{stop, GetWalkingTime(coordinates, stop->coordinates)});
+    }
+    return stops;
+}
+
+// The all-pairs tables give the weight of every pair at once, so only the
+// best pair is built. ON_DEMAND runs one search from all the sources
+std::optional<TransportRouter::TerminalRoute> TransportRouter::BuildTerminalRoute(
+    const std::vector<StopAccess>& sources, const std::vector<StopAccess>& targets) const {
+    if (std::holds_alternative<graph::DijkstraRouter<Minutes>>(router_)) {
+        using Terminal = graph::DijkstraRouter<Minutes>::Terminal;
+
+        const auto to_terminals = [this](const std::vector<StopAccess>& stops) {
+            std::vector<Terminal> terminals;
+            terminals.reserve(stops.size());
+            for (const auto& access : stops) {
+                terminals.push_back(Terminal{GetStopVertex(access.stop->id), access.walk});
+            }
+            return terminals;
+        };
+        return std::get<graph::DijkstraRouter<Minutes>>(router_).BuildRoute(to_terminals(sources), to_terminals(targets));
+    }
+
+    std::optional<TerminalRoute> best;
+    Minutes best_time{};
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (size_t j = 0; j < targets.size(); ++j) {
+            const auto weight = GetGraphRouteWeight(GetStopVertex(sources[i].stop->id), GetStopVertex(targets[j].stop->id));
+            if (weight && (!best || sources[i].walk + *weight + targets[j].walk < best_time)) {
+                best = TerminalRoute{i, j, {}};
+                best_time = sources[i].walk + *weight + targets[j].walk;
+            }
+        }
+    }
+    if (!best) {
+        return std::nullopt;
+    }
+
+    const auto from = GetStopVertex(sources[best->source].stop->id);
+    const auto to = GetStopVertex(targets[best->target].stop->id);
+    best->route = *BuildGraphRoute(from, to);
+    return best;
+}
+
+Minutes TransportRouter::GetWalkingTime(geo::Coordinates from, geo::Coordinates to) const {
+    const double distance = from == to ? 0.0 : geo::ComputeDistance(from, to);
+    return Minutes{distance / 1000 / walking_speed_ * 60};
+}
+
+RouteInfo TransportRouter::UnpackStopPairsRoute(StopId stop_from,
+                                                const graph::Router<Minutes>::RouteInfo& built_route) const {
+    RouteInfo route;
+
+    route.items.push_back(
+        RouteInfo::WaitItem{
+            .stop = GetStopName(stop_from),
+            .time = GetBusWaitingTime(),
+        }
+    );
+
+    Minutes total_time = GetBusWaitingTime();
+
+    for (size_t i = 1; i < built_route.edges.size(); ++i) {
+        auto edge = built_route.edges[i - 1];
+        const auto& info = edge_infos_[edge];
+
+        if (info.kind == EdgeDescription::Kind::RIDE) {
+            total_time += GetEdgeWeight(edge);
+
+            route.items.push_back(
+                RouteInfo::BusItem{
+                    .bus = GetBusName(info.bus),
+                    .span_count = info.span_count,
+                    .time = GetEdgeWeight(edge)
+                }
+            );
+        } else {
+            total_time += GetBusWaitingTime();
+
+            route.items.push_back(
+                RouteInfo::WaitItem{
+                    .stop = GetStopName(info.from),
+                    .time = GetBusWaitingTime()
+                }
+            );
+        }
+    }
+
+    route.total_time = total_time;
+    return route;
+}
+
+RouteInfo TransportRouter::UnpackRoute(StopId stop_from,
+                                       const graph::Router<Minutes>::RouteInfo& built_route) const {
+    switch (graph_model_) {
+        case GraphModel::STOP_PAIRS:
+            return UnpackStopPairsRoute(stop_from, built_route);
+        case GraphModel::RIDE_VERTICES:
+            return UnpackRideRoute(built_route);
+    }
+    throw std::logic_error("Unknown graph model");
+}
+
+RouteInfo TransportRouter::UnpackRideRoute(const graph::Router<Minutes>::RouteInfo& built_route) const {
+    RouteInfo route;
+    route.total_time = built_route.weight;
+
+    RouteInfo::BusItem ride{};
+    for (auto edge_id : built_route.edges) {
+        const auto& info = edge_infos_[edge_id];
+        switch (info.kind) {
+            case EdgeDescription::Kind::WAIT:
                 route.items.push_back(
                     RouteInfo::WaitItem{
-                        .stop = GetStopNameByIndex(GetStopIndexByName(from) + 1),
-                        .time = GetBusWaitingTime()
+                        .stop = GetStopName(info.from),
+                        .time = GetEdgeWeight(edge_id)
                     }
                 );
-            }
+                ride = RouteInfo::BusItem{
+                    .bus = GetBusName(info.bus),
+                    .span_count = 0,
+                    .time = Minutes{0}
+                };
+                break;
+            case EdgeDescription::Kind::ALIGHT:
+                route.items.push_back(ride);
+                break;
+            case EdgeDescription::Kind::RIDE:
+                ride.span_count += info.span_count;
+                ride.time += GetEdgeWeight(edge_id);
+                break;
         }
+    }
 
-        route.total_time = total_time;
-        return route;
+    return route;
+}
+
+// Unpacking a route of an outdated graph could name a removed bus or miss
+// a new stop, so stale routes are refused instead
+void TransportRouter::CheckUpToDate() const {
+    if (catalogue_version_ != catalogue_.GetVersion()) {
+        throw std::logic_error("The catalogue changed after the router was updated, call TransportRouter::Update");
     }
+}
 
+std::string_view TransportRouter::GetStopName(StopId stop) const {
+    return catalogue_.GetStop(stop)->name;
+}
+
+std::string_view TransportRouter::GetBusName(BusId bus) const {
+    return catalogue_.GetBus(bus)->name;
+}
+
+std::optional<graph::Router<Minutes>::RouteInfo> TransportRouter::BuildGraphRoute(size_t from, size_t to) const {
+    if (std::holds_alternative<graph::Router<Minutes>>(router_)) {
+        return std::get<graph::Router<Minutes>>(router_).BuildRoute(from, to);
+    } else if (std::holds_alternative<graph::BlockedRouter<Minutes>>(router_)) {
+        return std::get<graph::BlockedRouter<Minutes>>(router_).BuildRoute(from, to);
+    } else if (std::holds_alternative<graph::DijkstraRouter<Minutes>>(router_)) {
+        return std::get<graph::DijkstraRouter<Minutes>>(router_).BuildRoute(from, to);
+    }
     return std::nullopt;
 }
 
-size_t TransportRouter::GetStopIndexByName(const std::string& name) const {
-    return stop_index_by_name_.at(name.data());
+std::optional<Minutes> TransportRouter::GetGraphRouteWeight(size_t from, size_t to) const {
+    using BlockedRouter = graph::BlockedRouter<Minutes>;
+
+    if (std::holds_alternative<graph::Router<Minutes>>(router_)) {
+        if (const auto& route = std::get<graph::Router<Minutes>>(router_).GetRoutesInternalData()[from][to]) {
+            return route->weight;
+        }
+    } else if (std::holds_alternative<BlockedRouter>(router_)) {
+        const auto value = std::get<BlockedRouter>(router_).GetWeights()[from * graph_.GetVertexCount() + to];
+        if (value < BlockedRouter::Traits::Infinity()) {
+            return BlockedRouter::Traits::FromValue(value);
+        }
+    }
+    return std::nullopt;
 }
 
-const std::string& TransportRouter::GetStopNameByIndex(size_t index) const {
-    return stop_name_by_index_.at(index);
+const graph::DirectedWeightedGraph<Minutes>& TransportRouter::GetGraph() const {
+    return graph_;
 }
 
-std::pair<std::string_view, std::string_view> TransportRouter::GetStopsByEdgeId(size_t id) const {
-    auto edge = graph_.GetEdge(id);
-    std::pair<std::string_view, std::string_view> stops{stop_name_by_index_.at(edge.from), stop_name_by_index_.at(edge.to)};
-    return stops;
+graph::VertexId TransportRouter::GetStopVertex(std::string_view stop) const {
+    using namespace std::literals;
+
+    const Stop* found = catalogue_.GetStop(stop);
+    if (found == nullptr) {
+        throw std::out_of_range("Unknown stop '"s + std::string(stop) + "'"s);
+    }
+    return GetStopVertex(found->id);
+}
+
+graph::VertexId TransportRouter::GetStopVertex(StopId stop) const {
+    return graph_model_ == GraphModel::STOP_PAIRS ? graph::VertexId{stop} * 2 + 1 : graph::VertexId{stop};
 }
 
-std::optional<std::string_view> TransportRouter::GetBusByEdgeId(size_t edge_id) const {
-    if (!bus_by_edge_id_.count(edge_id)) {
+TransportRouter::EdgeDescription TransportRouter::DescribeEdge(graph::EdgeId edge_id) const {
+    const auto& info = edge_infos_.at(edge_id);
+    if (info.kind == EdgeDescription::Kind::RIDE) {
+        return {info.kind, {}, GetBusName(info.bus), info.span_count};
+    }
+    return {info.kind, GetStopName(info.from), {}, 0};
+}
+
+std::optional<TransportRouter::RouteTables> TransportRouter::GetRouteTables() const {
+    using BlockedRouter = graph::BlockedRouter<Minutes>;
+
+    if (std::holds_alternative<BlockedRouter>(router_)) {
+        const auto& router = std::get<BlockedRouter>(router_);
+        return RouteTables{router.GetWeights(), router.GetPrevEdges()};
+    } else if (!std::holds_alternative<graph::Router<Minutes>>(router_)) {
         return std::nullopt;
     }
 
-    return bus_by_edge_id_.at(edge_id);
+    const size_t vertex_count = graph_.GetVertexCount();
+    RouteTables tables{
+        std::vector<double>(vertex_count * vertex_count, BlockedRouter::Traits::Infinity()),
+        std::vector<graph::EdgeId>(vertex_count * vertex_count, BlockedRouter::NO_EDGE)
+    };
+
+    const auto& routes = std::get<graph::Router<Minutes>>(router_).GetRoutesInternalData();
+    for (size_t from = 0; from < vertex_count; ++from) {
+        for (size_t to = 0; to < vertex_count; ++to) {
+            if (const auto& route = routes[from][to]) {
+                tables.weights[from * vertex_count + to] = route->weight.count();
+                tables.prev_edges[from * vertex_count + to] = route->prev_edge.value_or(BlockedRouter::NO_EDGE);
+            }
+        }
+    }
+    return tables;
 }
 
 Minutes TransportRouter::GetEdgeWeight(size_t edge_id) const {
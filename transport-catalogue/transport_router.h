@@ -2,11 +2,21 @@
 
 #include "transport_catalogue.h"
 #include "router.h"
+#include "dijkstra_router.h"
+#include "blocked_router.h"
 #include "json.h"
+#include "lru_cache.h"
 
+#include <cstdint>
 #include <optional>
-#include <map>
+#include <span>
 #include <chrono>
+#include <variant>
+
+namespace serialization {
+class Reader;
+class Writer;
+}  // namespace serialization
 
 using Minutes = std::chrono::duration<double, std::chrono::minutes::period>;
 struct RouteInfo {
@@ -23,44 +33,225 @@ struct RouteInfo {
         Minutes time;
     };
 
-    using Item = std::variant<BusItem, WaitItem>;
+    // Walk between stops and the requested places, an empty name stands
+    // for the place
+    struct WalkItem {
+        std::string_view from;
+        std::string_view to;
+        Minutes time;
+    };
+
+    using Item = std::variant<BusItem, WaitItem, WalkItem>;
     std::vector<Item> items;
 };
 
+// End of a route: a stop, or a place reached on foot from the nearest stops
+using RoutePoint = std::variant<std::string_view, geo::Coordinates>;
+
+// ALL_PAIRS precomputes every route in the constructor and answers in O(1),
+// BLOCKED_ALL_PAIRS gives the same answers from flat matrices filled in parallel,
+// ON_DEMAND runs a Dijkstra search per request with linear startup and memory
+enum class RouterMode {
+    ALL_PAIRS,
+    BLOCKED_ALL_PAIRS,
+    ON_DEMAND,
+};
+
+RouterMode AsRouterMode(const json::Dict& settings);
+
+// STOP_PAIRS has two vertices per stop and an edge from every stop of a bus to
+// every later stop. RIDE_VERTICES adds a vertex per stop of every bus direction
+// with board (wait), ride and alight edges, so edges grow linearly with routes.
+enum class GraphModel {
+    STOP_PAIRS,
+    RIDE_VERTICES,
+};
+
+GraphModel AsGraphModel(const json::Dict& settings);
+
 class TransportRouter {
 public:
     TransportRouter() = delete;
     TransportRouter(const TransportCatalogue& catalogue, const json::Dict& settings);
-    
+    // Restores a router written by Serialize for the same catalogue,
+    // without rebuilding the graph or the route tables
+    TransportRouter(const TransportCatalogue& catalogue, serialization::Reader& reader);
+
+    TransportRouter(const TransportRouter&) = delete;
+    TransportRouter& operator=(const TransportRouter&) = delete;
+
+    // Routes are built for the catalogue version of the last Update. After
+    // later catalogue changes they throw std::logic_error until Update is called
+
+    // Empty for unknown stops
     std::optional<RouteInfo> BuildRoute(std::string_view stop1, std::string_view stop2) const;
+    std::optional<RouteInfo> BuildRoute(StopId from, StopId to) const;
+    // The same routes as BuildRoute from one stop to each of to. ON_DEMAND
+    // finds them all with one search that stops once every target is reached
+    std::vector<std::optional<RouteInfo>> BuildRoutes(StopId from, std::span<const StopId> to) const;
+    // A place is joined on foot with each of its walking_stops_count nearest
+    // stops at walking_speed, and the fastest of the rides between them is
+    // found with one search. Walking the whole way counts as a route too
+    std::optional<RouteInfo> BuildWalkingRoute(const RoutePoint& from, const RoutePoint& to) const;
+
+    // Applies the changes made to the catalogue since the router was built
+    // or last updated, see TransportCatalogue::GetChangesSince. Only the
+    // edges of the changed buses and stops are rebuilt, and the all-pairs
+    // modes search again only from the vertices whose routes may change.
+    // Not safe to call while routes are being built
+    void Update();
+
+    void Serialize(serialization::Writer& writer) const;
+
+    RouterMode GetRouterMode() const;
+
+    // Routes between stops are kept in a cache of the last
+    // routing_settings.route_cache_size pairs, none by default
+    using RouteCache = LruCache<uint64_t, std::optional<RouteInfo>>;
+    RouteCache::Stats GetRouteCacheStats() const;
+
+    // Route tables of the all-pairs modes as row-major V x V matrices of
+    // BlockedRouter, infinity and NO_EDGE mark missing routes
+    struct RouteTables {
+        std::vector<double> weights;
+        std::vector<graph::EdgeId> prev_edges;
+    };
+
+    // Route item an edge contributes to. WAIT edges wait for a bus at the stop,
+    // RIDE edges ride the bus span_count stops, ALIGHT edges end the ride
+    struct EdgeDescription {
+        enum class Kind : uint8_t {
+            WAIT,
+            RIDE,
+            ALIGHT,
+        };
+
+        Kind kind;
+        std::string_view stop;
+        std::string_view bus;
+        size_t span_count = 0;
+    };
+
+    // Everything needed to answer routes without the router, see CatalogueView.
+    // GetRouteTables is empty in the ON_DEMAND mode
+    const graph::DirectedWeightedGraph<Minutes>& GetGraph() const;
+    // Stop X has vertex X in RIDE_VERTICES. In STOP_PAIRS it has vertex
+    // 2X + 1 and its wait vertex 2X. Throws std::out_of_range for an unknown stop
+    graph::VertexId GetStopVertex(std::string_view stop) const;
+    graph::VertexId GetStopVertex(StopId stop) const;
+    EdgeDescription DescribeEdge(graph::EdgeId edge_id) const;
+    std::optional<RouteTables> GetRouteTables() const;
+    Minutes GetBusWaitingTime() const;
 
 private:
-    void AddEdge(
-        std::string_view from,
-        std::string_view to,
-        double weight,
-        std::string_view bus
-    );
-
-    size_t GetStopIndexByName(const std::string& name) const;
-    const std::string& GetStopNameByIndex(size_t index) const;
-
-    std::pair<std::string_view, std::string_view> GetStopsByEdgeId(size_t edge_id) const;
-    std::optional<std::string_view> GetBusByEdgeId(size_t edge_id) const;
-    
+    // Stop where a route rides from or to, with the walk to the place
+    struct StopAccess {
+        const Stop* stop;
+        Minutes walk;
+    };
+
+    using TerminalRoute = graph::DijkstraRouter<Minutes>::TerminalRouteInfo;
+
+    // Route item of an edge, from and to are the same stop for WAIT and
+    // ALIGHT edges. The bus of a RIDE_VERTICES WAIT edge is the one boarded
+    struct EdgeInfo {
+        EdgeDescription::Kind kind;
+        StopId from;
+        StopId to;
+        BusId bus = 0;
+        uint32_t span_count = 0;
+    };
+
+    struct InfoEdge {
+        graph::Edge<Minutes> edge;
+        EdgeInfo info;
+    };
+
+    // Edges an update changed, by the edge ids before it: their ids after
+    // it, NO_EDGE for removed ones, and the heavier and removed ones. The
+    // lighter and new edges are listed with the new ids
+    struct UpdatedEdges {
+        std::vector<graph::EdgeId> new_ids;
+        std::vector<bool> is_heavier;
+        std::vector<graph::EdgeId> lighter;
+    };
+
+    // Throws std::logic_error when the catalogue changed after the last Update
+    void CheckUpToDate() const;
+
+    void BuildGraph();
+    void BuildRouter(RouterMode mode);
+    void Rebuild();
+    // Makes the router of an all-pairs mode from tables of the graph
+    void SetRouteTables(RouterMode mode, RouteTables tables);
+    RouteTables UpdateRouteTables(const RouteTables& old_tables,
+                                  size_t old_vertex_count,
+                                  const UpdatedEdges& updated_edges) const;
+
+    // Edges of the bus in the order they are added to the graph. Its ride
+    // vertices are numbered from first_ride_vertex on
+    std::vector<InfoEdge> MakeBusEdges(BusId bus, graph::VertexId first_ride_vertex) const;
+    // Ride vertices of the bus in RIDE_VERTICES, 0 in STOP_PAIRS
+    size_t CountRideVertices(BusId bus) const;
+    template <typename StopIt>
+    void AddRideChain(BusId bus, StopIt begin, StopIt end, graph::VertexId& next_ride_vertex,
+                      std::vector<InfoEdge>& edges) const;
+    InfoEdge MakeWaitEdge(StopId stop) const;
+    InfoEdge MakeStopPairsEdge(
+        StopId from,
+        StopId to,
+        double distance,
+        BusId bus,
+        size_t span_count
+    ) const;
+    // Edges of buses change with them, STOP_PAIRS wait edges belong to stops
+    bool IsBusEdge(const EdgeInfo& info) const;
+
+    RouteInfo UnpackStopPairsRoute(StopId stop_from,
+                                   const graph::Router<Minutes>::RouteInfo& built_route) const;
+    RouteInfo UnpackRideRoute(const graph::Router<Minutes>::RouteInfo& built_route) const;
+    RouteInfo UnpackRoute(StopId stop_from, const graph::Router<Minutes>::RouteInfo& built_route) const;
+
+    void AddEdge(const InfoEdge& edge);
+
+    std::string_view GetStopName(StopId stop) const;
+    std::string_view GetBusName(BusId bus) const;
+
+    std::optional<graph::Router<Minutes>::RouteInfo> BuildGraphRoute(size_t from, size_t to) const;
+    // Weight of the route from the all-pairs tables, without building it
+    std::optional<Minutes> GetGraphRouteWeight(size_t from, size_t to) const;
+
+    // Empty for an unknown stop
+    std::vector<StopAccess> FindAccessStops(const RoutePoint& point) const;
+    std::optional<TerminalRoute> BuildTerminalRoute(const std::vector<StopAccess>& sources,
+                                                    const std::vector<StopAccess>& targets) const;
+    Minutes GetWalkingTime(geo::Coordinates from, geo::Coordinates to) const;
+
+    void SerializeRouter(serialization::Writer& writer) const;
+    void DeserializeRouter(serialization::Reader& reader);
+
     Minutes GetEdgeWeight(size_t edge_id) const;
-    Minutes GetBusWaitingTime() const;
 
     const TransportCatalogue& catalogue_;
+    GraphModel graph_model_;
     graph::DirectedWeightedGraph<Minutes> graph_;
-    std::optional<graph::Router<Minutes>> router_;
-
-    std::map<std::string, size_t> stop_index_by_name_;
-    std::map<size_t, std::string> stop_name_by_index_;
+    std::variant<
+        std::monostate,
+        graph::Router<Minutes>,
+        graph::BlockedRouter<Minutes>,
+        graph::DijkstraRouter<Minutes>>
+            router_;
 
-    std::map<size_t, std::string_view> bus_by_edge_id_;
+    // Indexed by edge id
+    std::vector<EdgeInfo> edge_infos_;
 
     Minutes waiting_time_;
     double bus_velocity_;
-    size_t edge_id_;
+    // km/h like bus_velocity
+    double walking_speed_ = 5.0;
+    size_t walking_stops_count_ = 3;
+    // Empty when routes are not cached. Keyed by the stop ids of the route
+    mutable std::optional<RouteCache> route_cache_;
+    // Version of the catalogue the router is up to date with
+    uint64_t catalogue_version_ = 0;
 };